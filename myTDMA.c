@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // 用于pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h> // 用于rand和srand函数
 #include <time.h>   // 用于时间函数
@@ -5,11 +6,24 @@
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <stddef.h>   // 用于offsetof
+#include <fcntl.h>    // 用于open
+#include <unistd.h>   // 用于close
+#include <sys/mman.h> // 用于mmap
+#include <sys/stat.h> // 用于fstat
+#include <pthread.h>  // 分片引擎的工作线程
+#include <sched.h>    // 用于CPU绑定和sched_yield
+#include "tdma_stats.h"
 
 #define NUM_DRONES_PER_CLUSTER 20
+#ifndef NUM_CLUSTERS
 #define NUM_CLUSTERS 1
+#endif
 #define SLOT_TIME 51.2 // 每个时隙的时间长度，以微秒为单位
+#ifndef TOTAL_TIME_SLOTS
 #define TOTAL_TIME_SLOTS 1000 // 总模拟时隙数（调整以匹配新的时隙长度）
+#endif
 
 
 //退避参数
@@ -18,6 +32,33 @@
 #define CW_P1 8
 #define CW_P2 16
 #define CW_P3 24
+// 退避窗口下限：窗口为1时退避时隙数固定，两个节点一旦冲突就会每次选到同样的退避而永远冲突
+#define CW_MIN 2
+#define CW_FLOOR(w) ((w) < CW_MIN ? CW_MIN : (w))
+// 连续冲突时退避窗口翻倍的最多次数（按类别）：窗口固定时十几个饱和节点的小窗口几乎每次都冲突，
+// 高优先级类别的窗口最小，反而时延最大；翻倍上限也按优先级递增，过载时控制包的窗口仍然最小
+#define CW_STAGE_P1 2
+#define CW_STAGE_P2 3
+#define CW_STAGE_P3 5
+#define CW_MAX_STAGE CW_STAGE_P3
+// 能量归一化基准（RE_W = energy / MAX_ENERGY）
+#define MAX_ENERGY 72
+// 能量等级数（ZREi_w = 1..3）
+#define NUM_TIERS 3
+
+// 业务优先级类别，数值越小优先级越高，依次对应DP "00"/"01"/"10"
+#define NUM_CLASSES 3
+typedef enum {
+    CLASS_CONTROL = 0,   // 控制 (CW_P1)
+    CLASS_TELEMETRY = 1, // 遥测 (CW_P2)
+    CLASS_VIDEO = 2      // 视频 (CW_P3)
+} TrafficClass;
+// 默认业务构成：控制、遥测、视频所占比例
+#define MIX_CONTROL 0.2
+#define MIX_TELEMETRY 0.5
+#define MIX_VIDEO 0.3
+// 每个节点发送队列的长度
+#define QUEUE_LEN 4
 
 // 请求帧大小 (单位: bits)
 #define RTS_SIZE (15 * 8)
@@ -49,6 +90,16 @@
 // 大数据包时隙
 #define PACKET_SLOT 3
 
+// 簇间中继交换时隙
+#define EXTRA_SLOT 1
+
+// 一次成功的RTS/CTS/DATA/ACI/BEACON/PACKET交换占用的时隙数
+#define CYCLE_SLOTS (RTS_SLOT + CTS_SLOT + DATA_SLOT + ACI_SLOT + BEACON_SLOT + PACKET_SLOT)
+// 退避窗口中每个单位对应的时隙数
+#define BACKOFF_UNIT 8
+// 时延小于该值的包不计入统计
+#define MIN_DELAY_SLOT 8
+
 
 // 定义一个枚举类型来表示不同的信道状态
 typedef enum {
@@ -63,6 +114,12 @@ typedef enum {
     CHANNEL_PACKET = 7    // 被包占有
 } ChannelState;
 
+// 待发送的数据包
+typedef struct {
+    int cls;          // 业务类别
+    int arrival_slot; // 产生时隙
+} Packet;
+
 // 定义表示无人机的Node结构
 typedef struct {
     int id;           // 无人机ID
@@ -74,13 +131,16 @@ typedef struct {
     bool want_to_send; //节点是否有数据要发
     bool able_send; //节点能否发
     int back_off_slot; //节点要退避的时隙数
+    int back_off_stage; //队首包连续冲突的次数（退避窗口按2的幂增长，发送成功后清零）
     bool is_dead;
     int dead_slot;
-    bool delay_first;
     int total_delay_slot;
     int total_sent_packet;
     int total_throught_put;
     bool success_flag;
+    double class_mix[NUM_CLASSES]; // 本节点的业务构成：默认取--mix，场景文件可以逐架指定
+    Packet queue[QUEUE_LEN]; // 按(类别, 产生时隙)排序，queue[0]为正在竞争的包
+    int queue_len;
 } Node;
 
 // 定义表示信道的Channel结构
@@ -98,106 +158,1072 @@ typedef struct {
     Channel channel; // 每个簇都有一个信道
     int head_id;     // 簇头节点的ID
     int node_num; //簇内节点数量
+    uint64_t rng;    // 簇内随机数状态，见cluster_rand
 } Cluster;
 
-// 全局变量，用于统计每个簇的发送次数、延迟时间和总传输字节数
-volatile int total_clash_slot[NUM_CLUSTERS] = {0};
-volatile int total_idle_slot[NUM_CLUSTERS] = {0};
-volatile int total_rts[NUM_CLUSTERS] = {0};
-volatile int total_cts[NUM_CLUSTERS] = {0};
-volatile int total_data[NUM_CLUSTERS] = {0};
-volatile int total_aci[NUM_CLUSTERS] = {0};
-volatile int total_beacon[NUM_CLUSTERS] = {0};
-volatile int total_packet[NUM_CLUSTERS] = {0};
+// 每个簇的信道计数器（布局见tdma_stats.h），引擎直接在本地数组上累加，
+// 开启--shm时定期在seqlock保护下发布到共享内存段
+ClusterCounters counters[NUM_CLUSTERS];
 
+// 共享内存统计段的发布状态
+typedef struct {
+    TdmaStatsHeader* header; // 为NULL表示未开启
+    const char* name;
+    size_t size;
+    double start_ms;
+    double last_ms;
+    int last_slot;
+} StatsSegment;
+StatsSegment stats_segment;
+// 两次发布之间的最短间隔（毫秒）
+#define STATS_PUBLISH_MS 50
+
+// 每个簇按业务类别统计
+typedef struct {
+    int arrived;     // 产生的包数
+    int rejected;    // 队列满且优先级不够而被拒绝的包数
+    int preempted;   // 被高优先级包挤出队列的包数
+    int sent;        // 成功发送的包数
+    long delay_slot; // 成功发送的包的总时延（不做MIN_DELAY_SLOT过滤）
+} ClassStats;
+ClassStats class_stats[NUM_CLUSTERS][NUM_CLASSES];
+
+// 退避窗口表 CW_DP / 2^ZREi_w，按[类别][能量等级]预先算好
+const int cw_table[NUM_CLASSES][NUM_TIERS] = {
+    {CW_FLOOR(CW_P1 / 2), CW_FLOOR(CW_P1 / 4), CW_FLOOR(CW_P1 / 8)},
+    {CW_FLOOR(CW_P2 / 2), CW_FLOOR(CW_P2 / 4), CW_FLOOR(CW_P2 / 8)},
+    {CW_FLOOR(CW_P3 / 2), CW_FLOOR(CW_P3 / 4), CW_FLOOR(CW_P3 / 8)},
+};
+// 各类别退避窗口最多翻倍的次数
+const int cw_max_stage[NUM_CLASSES] = {CW_STAGE_P1, CW_STAGE_P2, CW_STAGE_P3};
+const char* class_name[NUM_CLASSES] = {"control", "telemetry", "video"};
+double default_mix[NUM_CLASSES] = {MIX_CONTROL, MIX_TELEMETRY, MIX_VIDEO};
+
+// 业务模型：每want_period个时隙，不想发的节点以want_prob的概率产生数据
+int want_period = 10;
+double want_prob = 0.5;
+
+// 安静模式下关闭逐时隙日志（校准等批量运行时使用）
+bool quiet_mode = false;
+#define SLOT_LOG(...) do { if (!quiet_mode) printf(__VA_ARGS__); } while (0)
+
+
+
+
+// 初始化单个无人机的状态
+void init_node(Node* node, int id, int is_head, double x, double y, int energy) {
+    memset(node, 0, sizeof(Node));
+    node->id = id;
+    node->is_head = is_head;
+    node->x = x;
+    node->y = y;
+    node->energy = energy;
+
+    node->start_slot = -1; // 初始化发送开始时隙编号
+    node->end_slot = -1;   // 初始化发送成功时隙编号
+    node->want_to_send = false;
+    node->able_send = false;
+    node->is_dead = false;
+    node->success_flag = false;
+    node->queue_len = 0;
+    for (int k = 0; k < NUM_CLASSES; ++k) node->class_mix[k] = default_mix[k];
+
+    node->back_off_slot = 0;
+    node->total_delay_slot = 0;
+    node->total_sent_packet = 0;
+    node->total_throught_put = 0;
+    node->dead_slot = -1;
+}
 
+// 初始化簇内信道
+void init_cluster(Cluster* cluster, int id, int node_num) {
+    cluster->id = id;
+    cluster->node_num = node_num;
+    // back_off按head_id把簇头排除在退避之外，但簇头会一直参与竞争（见judge_send），
+    // 排除后簇内会永久冲突，所以这里保持不匹配任何节点，簇头照常退避
+    cluster->head_id = -1;
+    counters[id].alive = node_num;
+    // 引擎内的抽样都用簇自己的随机数序列，种子仍由srand决定
+    cluster->rng = (uint64_t)rand() << 32 ^ (uint64_t)rand() ^ (uint64_t)id;
+
+    //簇内信道
+    cluster->channel.state = CHANNEL_IDLE; // 初始化信道为空闲状态
+    cluster->channel.state_update_slot = -1; // 相当于上一时隙空闲
+    cluster->channel.owner_id = -1;
+    cluster->channel.nch_id = -1;
+}
 
+// 在堆上分配全部簇的状态：-DNUM_CLUSTERS很大时放在栈上会溢出，每个子命令各放一份静态数组又会让bss成倍膨胀；
+// calloc的页面在用到时才真正占用内存
+Cluster* alloc_clusters() {
+    Cluster* clusters = calloc(NUM_CLUSTERS, sizeof(Cluster));
+    if (!clusters) {
+        fprintf(stderr, "cannot allocate %d clusters (%zu bytes)\n", NUM_CLUSTERS, NUM_CLUSTERS * sizeof(Cluster));
+        exit(1);
+    }
+    return clusters;
+}
 
 // 初始化簇并分配无人机ID，并确定簇头和随机位置坐标
 void initialize_clusters(Cluster clusters[]) {
     for (int c = 0; c < NUM_CLUSTERS; ++c) {
-        clusters[c].id = c;
-        clusters[c].node_num = NUM_DRONES_PER_CLUSTER;
+        init_cluster(&clusters[c], c, NUM_DRONES_PER_CLUSTER);
 
         double range_start = c * 1000; // 根据簇ID确定坐标范围起点
         double range_end = (c + 1) * 1000; // 根据簇ID确定坐标范围终点
 
         for (int d = 0; d < NUM_DRONES_PER_CLUSTER; ++d) {
-            clusters[c].drones[d].id = c * NUM_DRONES_PER_CLUSTER + d + 1;
+            // 为无人机分配初始能量
+            int energy = rand() % 23 + 50; // 随机整数范围 [50, 72]
+
+            int is_head = d == 0; //0号节点为簇头
+            if (is_head) energy = 10000; //簇头节点能量大
+
+            // 为无人机分配随机位置坐标，基于当前簇的坐标范围
+            double x = ((double)rand() / RAND_MAX) * (range_end - range_start) + range_start;
+            double y = ((double)rand() / RAND_MAX) * (range_end - range_start) + range_start;
+
+            init_node(&clusters[c].drones[d], c * NUM_DRONES_PER_CLUSTER + d + 1, is_head, x, y, energy);
+        }
+    }
+}
+
+// 二进制场景文件：文件头 + 各簇偏移 + 按列存放的无人机数组，各段按SCENARIO_ALIGN字节对齐。
+// 簇c的无人机下标范围为 [cluster_start[c], cluster_start[c+1])。
+#define SCENARIO_MAGIC "TDMS"
+#define SCENARIO_VERSION 2 // 版本2增加了可选的业务构成列；版本1的文件仍可读取
+#define SCENARIO_ALIGN 64
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_clusters;
+    uint32_t reserved;
+    uint64_t num_drones;
+    uint64_t cluster_offset; // uint64_t[num_clusters + 1]
+    uint64_t id_offset;      // int32_t[num_drones]
+    uint64_t x_offset;       // double[num_drones]
+    uint64_t y_offset;       // double[num_drones]
+    uint64_t energy_offset;  // int32_t[num_drones]
+    uint64_t role_offset;    // uint8_t[num_drones]，1表示簇头
+    uint64_t mix_offset;     // double[num_drones][NUM_CLASSES]，0表示没有这一段（全部用--mix）
+} ScenarioHeader;
+
+// 映射到内存中的场景，各指针直接指向文件映射
+typedef struct {
+    void* base;
+    size_t size;
+    const ScenarioHeader* header;
+    const uint64_t* cluster_start;
+    const int32_t* id;
+    const double* x;
+    const double* y;
+    const int32_t* energy;
+    const uint8_t* role;
+    const double* mix;       // 每架无人机的业务构成，为NULL或某行第一个值为负时用--mix
+} Scenario;
+
+// 检查某一段是否对齐且完整落在文件内
+bool scenario_section_ok(size_t file_size, uint64_t offset, uint64_t count, size_t elem_size) {
+    if (offset % SCENARIO_ALIGN != 0 || offset > file_size) return false;
+    return count <= (file_size - offset) / elem_size;
+}
+
+// 映射场景文件，只校验文件头和簇偏移，不读取无人机数据，所以加载时间与无人机数量无关
+bool load_scenario(const char* path, Scenario* sc) {
+    memset(sc, 0, sizeof(Scenario));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ScenarioHeader)) {
+        fprintf(stderr, "%s: not a scenario file\n", path);
+        close(fd);
+        return false;
+    }
+    sc->size = st.st_size;
+    sc->base = mmap(NULL, sc->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (sc->base == MAP_FAILED) {
+        perror(path);
+        sc->base = NULL;
+        return false;
+    }
+
+    const ScenarioHeader* h = sc->base;
+    bool ok = memcmp(h->magic, SCENARIO_MAGIC, 4) == 0 && (h->version == 1 || h->version == SCENARIO_VERSION) &&
+              scenario_section_ok(sc->size, h->cluster_offset, (uint64_t)h->num_clusters + 1, sizeof(uint64_t)) &&
+              scenario_section_ok(sc->size, h->id_offset, h->num_drones, sizeof(int32_t)) &&
+              scenario_section_ok(sc->size, h->x_offset, h->num_drones, sizeof(double)) &&
+              scenario_section_ok(sc->size, h->y_offset, h->num_drones, sizeof(double)) &&
+              scenario_section_ok(sc->size, h->energy_offset, h->num_drones, sizeof(int32_t)) &&
+              scenario_section_ok(sc->size, h->role_offset, h->num_drones, sizeof(uint8_t));
+    // 版本1的文件头较短，mix_offset落在对齐填充里，不可信
+    bool has_mix = ok && h->version >= 2 && h->mix_offset != 0;
+    if (has_mix) ok = h->num_drones <= UINT64_MAX / NUM_CLASSES &&
+                      scenario_section_ok(sc->size, h->mix_offset, h->num_drones * NUM_CLASSES, sizeof(double));
+    if (ok) {
+        const char* base = sc->base;
+        sc->header = h;
+        sc->cluster_start = (const uint64_t*)(base + h->cluster_offset);
+        sc->id = (const int32_t*)(base + h->id_offset);
+        sc->x = (const double*)(base + h->x_offset);
+        sc->y = (const double*)(base + h->y_offset);
+        sc->energy = (const int32_t*)(base + h->energy_offset);
+        sc->role = (const uint8_t*)(base + h->role_offset);
+        sc->mix = has_mix ? (const double*)(base + h->mix_offset) : NULL;
+        ok = sc->cluster_start[0] == 0 && sc->cluster_start[h->num_clusters] == h->num_drones;
+        for (uint32_t c = 0; ok && c < h->num_clusters; ++c) {
+            ok = sc->cluster_start[c] <= sc->cluster_start[c + 1];
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: corrupt or unsupported scenario file\n", path);
+        munmap(sc->base, sc->size);
+        memset(sc, 0, sizeof(Scenario));
+        return false;
+    }
+    return true;
+}
+
+void unload_scenario(Scenario* sc) {
+    if (sc->base) munmap(sc->base, sc->size);
+    memset(sc, 0, sizeof(Scenario));
+}
 
-            // 为无人机分配初始能量（随机5-10之间的整数）
-            clusters[c].drones[d].energy = rand() % 23 + 50; // 随机整数范围 [50, 72]
+// 直接从映射的列数组初始化簇。簇数必须与编译时的NUM_CLUSTERS一致（否则按-DNUM_CLUSTERS=N重新编译），
+// 每个簇的无人机数不能超过NUM_DRONES_PER_CLUSTER；不满足时不截断，直接报错返回false
+bool initialize_clusters_from_scenario(Cluster clusters[], const Scenario* sc) {
+    if (sc->header->num_clusters != NUM_CLUSTERS) {
+        fprintf(stderr, "Scenario has %u clusters but this build simulates %d; rebuild with -DNUM_CLUSTERS=%u\n",
+                sc->header->num_clusters, NUM_CLUSTERS, sc->header->num_clusters);
+        return false;
+    }
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        uint64_t count = sc->cluster_start[c + 1] - sc->cluster_start[c];
+        if (count > NUM_DRONES_PER_CLUSTER) {
+            fprintf(stderr, "Scenario cluster %d has %llu drones but this build holds at most %d per cluster\n", c,
+                    (unsigned long long)count, NUM_DRONES_PER_CLUSTER);
+            return false;
+        }
+    }
 
-            if(d)clusters[c].drones[d].is_head = 0;
-            else {//0号节点为簇头
-                clusters[c].drones[d].is_head =1;
-                clusters[c].drones[d].energy = 10000;//簇头节点能量大
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        uint64_t begin = sc->cluster_start[c];
+        uint64_t count = sc->cluster_start[c + 1] - begin;
+        init_cluster(&clusters[c], c, (int)count);
+        for (uint64_t d = 0; d < count; ++d) {
+            uint64_t i = begin + d;
+            init_node(&clusters[c].drones[d], sc->id[i], sc->role[i] != 0, sc->x[i], sc->y[i], sc->energy[i]);
+            if (sc->mix && sc->mix[i * NUM_CLASSES] >= 0) {
+                memcpy(clusters[c].drones[d].class_mix, &sc->mix[i * NUM_CLASSES], NUM_CLASSES * sizeof(double));
             }
+        }
+    }
+    return true;
+}
 
-            // 为无人机分配随机位置坐标，基于当前簇的坐标范围
-            clusters[c].drones[d].x = ((double)rand() / RAND_MAX) * (range_end - range_start) + range_start;
-            clusters[c].drones[d].y = ((double)rand() / RAND_MAX) * (range_end - range_start) + range_start;
+uint64_t align_up(uint64_t offset) {
+    return (offset + SCENARIO_ALIGN - 1) / SCENARIO_ALIGN * SCENARIO_ALIGN;
+}
 
+// 写入一段数据，先用0填充到offset
+bool write_section(FILE* out, uint64_t* pos, uint64_t offset, const void* data, size_t bytes) {
+    static const char zeros[SCENARIO_ALIGN] = {0};
+    if (fwrite(zeros, 1, offset - *pos, out) != offset - *pos) return false;
+    if (bytes && fwrite(data, 1, bytes, out) != bytes) return false;
+    *pos = offset + bytes;
+    return true;
+}
 
+// 把 "cluster,id,x,y,energy,role[,control,telemetry,video]" 格式的CSV转换成二进制场景文件，
+// 行可以任意顺序，转换时按簇稳定排序；以非数字开头的行（如表头）被跳过。
+// 末尾三列是该无人机的业务构成（按比例归一化），省略时运行时用--mix；任何一行给出时才写入业务构成段
+int convert_scenario(const char* csv_path, const char* out_path) {
+    FILE* in = fopen(csv_path, "r");
+    if (!in) {
+        perror(csv_path);
+        return 1;
+    }
 
-            clusters[c].drones[d].start_slot = -1; // 初始化发送开始时隙编号
-            clusters[c].drones[d].end_slot = -1;   // 初始化发送成功时隙编号
-            clusters[c].drones[d].want_to_send = false;
-            clusters[c].drones[d].able_send = false;
-            clusters[c].drones[d].is_dead = false;
-            clusters[c].drones[d].delay_first = true;
-            clusters[c].drones[d].success_flag = false;
+    size_t cap = 1024, n = 0;
+    int32_t* row_cluster = malloc(cap * sizeof(int32_t));
+    int32_t* row_id = malloc(cap * sizeof(int32_t));
+    double* row_x = malloc(cap * sizeof(double));
+    double* row_y = malloc(cap * sizeof(double));
+    int32_t* row_energy = malloc(cap * sizeof(int32_t));
+    uint8_t* row_role = malloc(cap);
+    double* row_mix = malloc(cap * NUM_CLASSES * sizeof(double));
+    bool any_mix = false;
+    int32_t max_cluster = -1;
+    char line[256];
+    long line_no = 0;
+    int rc = 1;
+
+    while (fgets(line, sizeof(line), in)) {
+        line_no++;
+        int cluster, id, energy, role;
+        double x, y, mix[NUM_CLASSES];
+        int fields = sscanf(line, "%d,%d,%lf,%lf,%d,%d,%lf,%lf,%lf", &cluster, &id, &x, &y, &energy, &role, &mix[0], &mix[1],
+                            &mix[2]);
+        if (fields != 6 && fields != 6 + NUM_CLASSES) {
+            if (line[0] == '-' || (line[0] >= '0' && line[0] <= '9')) {
+                fprintf(stderr, "%s:%ld: expected cluster,id,x,y,energy,role[,control,telemetry,video]\n", csv_path, line_no);
+                goto done;
+            }
+            continue;
+        }
+        if (fields == 6) {
+            mix[0] = -1;
+        } else {
+            double sum = 0;
+            for (int k = 0; k < NUM_CLASSES; ++k) sum += mix[k];
+            if (sum <= 0 || mix[0] < 0 || mix[1] < 0 || mix[2] < 0) {
+                fprintf(stderr, "%s:%ld: traffic mix must be non-negative with a positive sum\n", csv_path, line_no);
+                goto done;
+            }
+            for (int k = 0; k < NUM_CLASSES; ++k) mix[k] /= sum;
+            any_mix = true;
+        }
+        if (cluster < 0) {
+            fprintf(stderr, "%s:%ld: negative cluster id\n", csv_path, line_no);
+            goto done;
+        }
+        if (n == cap) {
+            cap *= 2;
+            row_cluster = realloc(row_cluster, cap * sizeof(int32_t));
+            row_id = realloc(row_id, cap * sizeof(int32_t));
+            row_x = realloc(row_x, cap * sizeof(double));
+            row_y = realloc(row_y, cap * sizeof(double));
+            row_energy = realloc(row_energy, cap * sizeof(int32_t));
+            row_role = realloc(row_role, cap);
+            row_mix = realloc(row_mix, cap * NUM_CLASSES * sizeof(double));
+        }
+        row_cluster[n] = cluster;
+        row_id[n] = id;
+        row_x[n] = x;
+        row_y[n] = y;
+        row_energy[n] = energy;
+        row_role[n] = role != 0;
+        memcpy(&row_mix[n * NUM_CLASSES], mix, NUM_CLASSES * sizeof(double));
+        if (cluster > max_cluster) max_cluster = cluster;
+        n++;
+    }
 
-            clusters[c].drones[d].back_off_slot = 0;
-            clusters[c].drones[d].total_delay_slot = 0;
-            clusters[c].drones[d].total_sent_packet = 0;
-            clusters[c].drones[d].dead_slot = -1;
+    ScenarioHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SCENARIO_MAGIC, 4);
+    h.version = SCENARIO_VERSION;
+    h.num_clusters = max_cluster + 1;
+    h.num_drones = n;
+    h.cluster_offset = align_up(sizeof(h));
+    h.id_offset = align_up(h.cluster_offset + (h.num_clusters + 1) * sizeof(uint64_t));
+    h.x_offset = align_up(h.id_offset + n * sizeof(int32_t));
+    h.y_offset = align_up(h.x_offset + n * sizeof(double));
+    h.energy_offset = align_up(h.y_offset + n * sizeof(double));
+    h.role_offset = align_up(h.energy_offset + n * sizeof(int32_t));
+    h.mix_offset = any_mix ? align_up(h.role_offset + n) : 0;
+
+    // 计数排序：先算各簇起点，再把每行放到所在簇的下一个位置
+    uint64_t* start = calloc(h.num_clusters + 1, sizeof(uint64_t));
+    uint64_t* next = malloc((h.num_clusters + 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < n; ++i) start[row_cluster[i] + 1]++;
+    for (uint32_t c = 0; c < h.num_clusters; ++c) start[c + 1] += start[c];
+    memcpy(next, start, (h.num_clusters + 1) * sizeof(uint64_t));
+
+    int32_t* id = malloc(n * sizeof(int32_t) + 1);
+    double* x = malloc(n * sizeof(double) + 1);
+    double* y = malloc(n * sizeof(double) + 1);
+    int32_t* energy = malloc(n * sizeof(int32_t) + 1);
+    uint8_t* role = malloc(n + 1);
+    double* mix = malloc(n * NUM_CLASSES * sizeof(double) + 1);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t j = next[row_cluster[i]]++;
+        id[j] = row_id[i];
+        x[j] = row_x[i];
+        y[j] = row_y[i];
+        energy[j] = row_energy[i];
+        role[j] = row_role[i];
+        memcpy(&mix[j * NUM_CLASSES], &row_mix[i * NUM_CLASSES], NUM_CLASSES * sizeof(double));
+    }
 
+    FILE* out = fopen(out_path, "wb");
+    if (!out) {
+        perror(out_path);
+    } else {
+        uint64_t pos = 0;
+        bool ok = write_section(out, &pos, 0, &h, sizeof(h)) &&
+                  write_section(out, &pos, h.cluster_offset, start, (h.num_clusters + 1) * sizeof(uint64_t)) &&
+                  write_section(out, &pos, h.id_offset, id, n * sizeof(int32_t)) &&
+                  write_section(out, &pos, h.x_offset, x, n * sizeof(double)) &&
+                  write_section(out, &pos, h.y_offset, y, n * sizeof(double)) &&
+                  write_section(out, &pos, h.energy_offset, energy, n * sizeof(int32_t)) &&
+                  write_section(out, &pos, h.role_offset, role, n) &&
+                  (!any_mix || write_section(out, &pos, h.mix_offset, mix, n * NUM_CLASSES * sizeof(double)));
+        if (fclose(out) != 0) ok = false;
+        if (ok) {
+            printf("Wrote %s: %u clusters, %zu drones\n", out_path, h.num_clusters, n);
+            rc = 0;
+        } else {
+            perror(out_path);
         }
+    }
 
+    free(start);
+    free(next);
+    free(id);
+    free(x);
+    free(y);
+    free(energy);
+    free(role);
+    free(mix);
+done:
+    fclose(in);
+    free(row_cluster);
+    free(row_id);
+    free(row_x);
+    free(row_y);
+    free(row_energy);
+    free(row_role);
+    free(row_mix);
+    return rc;
+}
 
-        //簇内信道
-        clusters[c].channel.state = CHANNEL_IDLE; // 初始化信道为空闲状态
-        clusters[c].channel.owner_id = -1;
-        clusters[c].channel.nch_id = -1;
+// 簇内随机数（splitmix64）。每个簇一个独立序列，抽样结果与簇的处理顺序无关，
+// 分片并行的引擎与单线程引擎逐时隙一致
+uint32_t cluster_rand(Cluster* cluster) {
+    uint64_t z = cluster->rng += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
 
+// [0, 1)上的均匀分布
+double cluster_random(Cluster* cluster) {
+    return cluster_rand(cluster) / 4294967296.0;
+}
 
+// 按节点的业务构成抽取一个类别
+int draw_class(Cluster* cluster, Node* node){
+    double r = cluster_random(cluster);
+    for (int k = 0; k < NUM_CLASSES - 1; ++k) {
+        if (r < node->class_mix[k]) return k;
+        r -= node->class_mix[k];
     }
+    return NUM_CLASSES - 1;
+}
+
+// 队首包是否已进入交换：RTS成功之后到本次交换结束，nch_id指向它且信道不空闲
+bool in_exchange(Cluster* cluster, Node* node){
+    return cluster->channel.nch_id == node->id && cluster->channel.state > CHANNEL_RTS;
 }
 
+// 按类别准入：队列按优先级排序。queue[0]只在交换中不动，仅在退避时会被更高优先级的包顶替，
+// 否则控制包要排在冲突不断的视频包后面；
+// 队列满时新包挤掉优先级最低且最晚到达的包，优先级不够则被拒绝
+void enqueue_packet(Cluster* cluster, Node* node, int cls, int current_slot){
+    ClassStats* stats = class_stats[cluster->id];
+    stats[cls].arrived++;
+
+    if (node->queue_len == 0) {
+        node->queue[0].cls = cls;
+        node->queue[0].arrival_slot = current_slot;
+        node->queue_len = 1;
+        node->start_slot = current_slot;
+        node->want_to_send = true;
+        node->back_off_slot = 0;
+        return;
+    }
+
+    if (node->queue_len == QUEUE_LEN) {
+        Packet* last = &node->queue[QUEUE_LEN - 1];
+        if (QUEUE_LEN == 1 || last->cls <= cls) {
+            stats[cls].rejected++;
+            return;
+        }
+        stats[last->cls].preempted++;
+        node->queue_len--;
+    }
+
+    int pos = node->queue_len;
+    int first = in_exchange(cluster, node) ? 1 : 0;
+    while (pos > first && node->queue[pos - 1].cls > cls) {
+        node->queue[pos] = node->queue[pos - 1];
+        pos--;
+    }
+    node->queue[pos].cls = cls;
+    node->queue[pos].arrival_slot = current_slot;
+    node->queue_len++;
+}
 
+// 模拟一个簇内的无人机产生数据
+void cluster_want_to_send(Cluster* cluster, int current_slot) {
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if(cluster_random(cluster) < want_prob){
+            enqueue_packet(cluster, node, draw_class(cluster, node), current_slot);
+        }
+    }
+}
 
-// 模拟无人机想发送数据
+// 模拟无人机产生数据
 void random_want_to_send(Cluster clusters[], int current_slot) {
+    for (int c = 0; c < NUM_CLUSTERS; ++c) cluster_want_to_send(&clusters[c], current_slot);
+}
+
+
+
+
+
+
+
+// 清零所有统计量，便于同一进程内多次运行
+void reset_statistics() {
     for (int c = 0; c < NUM_CLUSTERS; ++c) {
-        for (int d = 0; d < NUM_DRONES_PER_CLUSTER; ++d) {
-            if((double)rand() / RAND_MAX < 0.5){
-                if(clusters[c].drones[d].want_to_send==false){
-                    clusters[c].drones[d].want_to_send=true;
-                    clusters[c].drones[d].back_off_slot=0;
+        int alive = counters[c].alive;
+        memset(&counters[c], 0, sizeof(ClusterCounters));
+        counters[c].alive = alive;
+        memset(class_stats[c], 0, sizeof(class_stats[c]));
+    }
+}
 
-                }
+// 单调时钟，单位毫秒
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// 创建共享内存统计段，tdma-top通过同名段查看进度
+bool open_stats_segment(const char* name, int total_slots) {
+    StatsSegment* seg = &stats_segment;
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(name);
+        return false;
+    }
+    seg->size = tdma_stats_size(NUM_CLUSTERS);
+    if (ftruncate(fd, seg->size) != 0) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void* base = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // 段在ftruncate后就已可见且全为0；magic最后写入，读者看到magic时其余字段都已就绪
+    TdmaStatsHeader* h = base;
+    h->version = TDMA_STATS_VERSION;
+    h->num_clusters = NUM_CLUSTERS;
+    h->total_slots = total_slots;
+    h->running = 1;
+    __atomic_store_n(&h->magic, TDMA_STATS_MAGIC, __ATOMIC_RELEASE);
+    seg->header = h;
+    seg->name = name;
+    seg->start_ms = seg->last_ms = now_ms();
+    seg->last_slot = 0;
+    return true;
+}
+
+// 把一份计数器快照发布到共享内存段；距上次发布不足STATS_PUBLISH_MS时跳过，除非force
+void publish_snapshot(int slot, const ClusterCounters* snapshot, bool force) {
+    StatsSegment* seg = &stats_segment;
+    if (!seg->header) return;
+    double now = now_ms();
+    if (!force && now - seg->last_ms < STATS_PUBLISH_MS) return;
+
+    TdmaStatsHeader* h = seg->header;
+    tdma_stats_write_begin(h);
+    h->slot = slot;
+    h->elapsed_sec = (now - seg->start_ms) / 1000;
+    if (now > seg->last_ms) h->slots_per_sec = (slot - seg->last_slot) * 1000.0 / (now - seg->last_ms);
+    memcpy(tdma_stats_counters(h), snapshot, sizeof(counters));
+    tdma_stats_write_end(h);
+
+    seg->last_ms = now;
+    seg->last_slot = slot;
+}
+
+// 发布当前计数器
+void publish_stats(int slot, bool force) {
+    publish_snapshot(slot, counters, force);
+}
+
+// 发布最终结果并标记结束，然后删除段（已连接的tdma-top仍能看到最后的快照）
+void close_stats_segment(int slot) {
+    StatsSegment* seg = &stats_segment;
+    if (!seg->header) return;
+    publish_stats(slot, true);
+    tdma_stats_write_begin(seg->header);
+    seg->header->running = 0;
+    tdma_stats_write_end(seg->header);
+    munmap(seg->header, seg->size);
+    shm_unlink(seg->name);
+    seg->header = NULL;
+}
+
+// ---------------- 簇间多跳中继 ----------------
+// 簇头把簇内成功收到的包聚合后，沿以汇聚节点为根的最短路径树逐跳转发，
+// 每一跳占用发送簇的一个CHANNEL_EXTRA交换。路由只在簇头死亡或移动时增量修复，
+// 每个时隙的中继开销只与正在转发的簇数有关。
+
+// 簇头之间（以及簇头与汇聚节点之间）的最大通信距离（米）
+#define RELAY_RANGE 2000.0
+// 每个簇头的中继缓冲长度
+#define RELAY_QUEUE_LEN 64
+// 一次簇间交换最多聚合的包数
+#define RELAY_AGG_MAX 8
+// 时延直方图的桶数和桶宽（时隙），最后一个桶收容所有更大的时延
+#define HIST_BINS 4096
+#define HIST_BIN_SLOTS 1
+
+#define ROUTE_NONE -1
+#define ROUTE_SINK NUM_CLUSTERS // 汇聚节点在路由树中的编号
+
+// 等待转发的包
+typedef struct {
+    int origin_slot; // 在源无人机产生的时隙
+    int hop_slot;    // 到达当前簇头的时隙
+    int hops;        // 已经过的簇间跳数
+    int cls;
+} RelayPacket;
+
+// 每个簇头的中继和路由状态
+typedef struct {
+    RelayPacket queue[RELAY_QUEUE_LEN]; // 环形缓冲
+    int queue_first;
+    int queue_len;
+    int dropped;        // 缓冲满或路由中断而丢弃的包
+    bool alive;         // 簇头是否还能转发
+    double x, y;        // 计算路由时簇头的位置
+    int head_index;     // 簇头在drones[]中的下标
+    int parent;         // 下一跳：簇编号、ROUTE_SINK或ROUTE_NONE
+    double cost;        // 到汇聚节点的路径代价
+    int first_child;    // 路由树中的孩子链表
+    int next_sibling;
+    int prev_sibling;
+    int next_in_cell;   // 网格中同一格的下一个簇
+} RelayState;
+
+// 交给相邻簇、下一时隙开始时生效的包
+typedef struct {
+    int dst;
+    RelayPacket packet;
+} RelayEvent;
+
+// 时延分布
+typedef struct {
+    long count;
+    long sum;
+    long bins[HIST_BINS];
+} DelayHistogram;
+
+// 一个时隙内各簇对其他簇的影响都先记在这里，下一时隙开始时才生效，
+// 所以时隙内每个簇只读写自己的中继状态（分片引擎依赖这一点）
+typedef struct {
+    RelayEvent pending[NUM_CLUSTERS * RELAY_AGG_MAX]; // 交给下一跳的包
+    int pending_num;
+    int repair[2 * NUM_CLUSTERS]; // 簇头死亡或移动、需要修复路由的簇
+    int repair_num;
+    DelayHistogram hop_delay; // 每一跳在簇头处的等待+传输时延
+    DelayHistogram e2e_delay; // 从产生到汇聚节点的端到端时延
+    long sink_delivered;
+} RelayOutput;
+
+bool relay_enabled = false;
+double sink_x = 0, sink_y = 0;
+RelayState relay[NUM_CLUSTERS];
+int sink_first_child = ROUTE_NONE;
+RelayOutput relay_main;
+// 单线程引擎写relay_main；分片引擎的工作线程指向本分片的RelayOutput，结束后合并
+__thread RelayOutput* relay_out = &relay_main;
+long route_updates = 0;    // 增量修复时被改写的路由条目数
+
+// 用于邻居查找的均匀网格，格宽不小于RELAY_RANGE，所以只需查3x3个格
+typedef struct {
+    double min_x, min_y, cell;
+    int nx, ny;
+    int* first; // 每格第一个簇
+} RelayGrid;
+RelayGrid relay_grid;
+
+// Dijkstra用的最小堆（惰性删除）
+typedef struct {
+    double cost;
+    int node;
+} HeapItem;
+HeapItem* route_heap;
+int route_heap_len, route_heap_cap;
+int route_scratch[NUM_CLUSTERS]; // 子树收集和邻居枚举用
+bool in_subtree[NUM_CLUSTERS];
+
+void histogram_add(DelayHistogram* h, int delay) {
+    int bin = delay / HIST_BIN_SLOTS;
+    if (bin >= HIST_BINS) bin = HIST_BINS - 1;
+    h->bins[bin]++;
+    h->count++;
+    h->sum += delay;
+}
+
+// 按桶估计分位数（取桶内最大时延），单位时隙；落在最后一个桶时返回-1
+int histogram_percentile(DelayHistogram* h, double q) {
+    long target = (long)ceil(q * h->count), seen = 0;
+    for (int b = 0; b < HIST_BINS - 1; ++b) {
+        seen += h->bins[b];
+        if (seen >= target && seen > 0) return (b + 1) * HIST_BIN_SLOTS - 1;
+    }
+    return -1;
+}
+
+void print_percentile(const char* label, DelayHistogram* h, double q) {
+    int slots = histogram_percentile(h, q);
+    if (slots < 0) printf(", %s: >%.6fms", label, (HIST_BINS - 1) * HIST_BIN_SLOTS * SLOT_TIME / 1000);
+    else printf(", %s: <=%.6fms", label, slots * SLOT_TIME / 1000);
+}
+
+void print_histogram(const char* name, DelayHistogram* h) {
+    if (!h->count) {
+        printf("%s delay: no samples\n", name);
+        return;
+    }
+    printf("%s delay: samples: %ld, avg: %.6fms", name, h->count, h->sum * SLOT_TIME / h->count / 1000);
+    print_percentile("p50", h, 0.5);
+    print_percentile("p90", h, 0.9);
+    print_percentile("p99", h, 0.99);
+    printf("\n");
+}
+
+void heap_push(double cost, int node) {
+    if (route_heap_len == route_heap_cap) {
+        route_heap_cap = route_heap_cap ? route_heap_cap * 2 : 64;
+        route_heap = realloc(route_heap, route_heap_cap * sizeof(HeapItem));
+    }
+    int i = route_heap_len++;
+    while (i > 0 && route_heap[(i - 1) / 2].cost > cost) {
+        route_heap[i] = route_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    route_heap[i].cost = cost;
+    route_heap[i].node = node;
+}
+
+HeapItem heap_pop() {
+    HeapItem top = route_heap[0], last = route_heap[--route_heap_len];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= route_heap_len) break;
+        if (child + 1 < route_heap_len && route_heap[child + 1].cost < route_heap[child].cost) child++;
+        if (route_heap[child].cost >= last.cost) break;
+        route_heap[i] = route_heap[child];
+        i = child;
+    }
+    if (route_heap_len > 0) route_heap[i] = last;
+    return top;
+}
+
+int grid_cell(double x, double y) {
+    int cx = (int)((x - relay_grid.min_x) / relay_grid.cell);
+    int cy = (int)((y - relay_grid.min_y) / relay_grid.cell);
+    if (cx < 0) cx = 0;
+    if (cx >= relay_grid.nx) cx = relay_grid.nx - 1;
+    if (cy < 0) cy = 0;
+    if (cy >= relay_grid.ny) cy = relay_grid.ny - 1;
+    return cy * relay_grid.nx + cx;
+}
+
+void grid_insert(int c) {
+    int cell = grid_cell(relay[c].x, relay[c].y);
+    relay[c].next_in_cell = relay_grid.first[cell];
+    relay_grid.first[cell] = c;
+}
+
+void grid_remove(int c) {
+    int* link = &relay_grid.first[grid_cell(relay[c].x, relay[c].y)];
+    while (*link != ROUTE_NONE && *link != c) link = &relay[*link].next_in_cell;
+    if (*link == c) *link = relay[c].next_in_cell;
+}
+
+// 列出(x, y)通信范围内所有存活的簇头
+int relay_neighbors(double x, double y, int out[]) {
+    int n = 0;
+    int cell = grid_cell(x, y);
+    int cx = cell % relay_grid.nx, cy = cell / relay_grid.nx;
+    for (int gy = cy - 1; gy <= cy + 1; ++gy) {
+        if (gy < 0 || gy >= relay_grid.ny) continue;
+        for (int gx = cx - 1; gx <= cx + 1; ++gx) {
+            if (gx < 0 || gx >= relay_grid.nx) continue;
+            for (int c = relay_grid.first[gy * relay_grid.nx + gx]; c != ROUTE_NONE; c = relay[c].next_in_cell) {
+                double dx = relay[c].x - x, dy = relay[c].y - y;
+                if (relay[c].alive && dx * dx + dy * dy <= RELAY_RANGE * RELAY_RANGE) out[n++] = c;
+            }
+        }
+    }
+    return n;
+}
+
+// 链路代价取距离平方（与发射能量成正比）
+double link_cost(double x1, double y1, double x2, double y2) {
+    return (x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2);
+}
+
+void route_set_parent(int c, int parent, double cost) {
+    RelayState* r = &relay[c];
+    int* first;
+    if (r->parent != ROUTE_NONE) {
+        first = r->parent == ROUTE_SINK ? &sink_first_child : &relay[r->parent].first_child;
+        if (r->prev_sibling != ROUTE_NONE) relay[r->prev_sibling].next_sibling = r->next_sibling;
+        else *first = r->next_sibling;
+        if (r->next_sibling != ROUTE_NONE) relay[r->next_sibling].prev_sibling = r->prev_sibling;
+    }
+    r->parent = parent;
+    r->cost = cost;
+    r->prev_sibling = r->next_sibling = ROUTE_NONE;
+    if (parent != ROUTE_NONE) {
+        first = parent == ROUTE_SINK ? &sink_first_child : &relay[parent].first_child;
+        r->next_sibling = *first;
+        if (*first != ROUTE_NONE) relay[*first].prev_sibling = c;
+        *first = c;
+    }
+    route_updates++;
+}
+
+// 让c尝试经由汇聚节点或任一有路由的邻居改进路径，改进则入堆
+void route_relax_from_neighbors(int c) {
+    RelayState* r = &relay[c];
+    double sink_cost = link_cost(r->x, r->y, sink_x, sink_y);
+    if (sink_cost <= RELAY_RANGE * RELAY_RANGE && sink_cost < r->cost) route_set_parent(c, ROUTE_SINK, sink_cost);
+
+    int n = relay_neighbors(r->x, r->y, route_scratch);
+    for (int i = 0; i < n; ++i) {
+        int w = route_scratch[i];
+        if (w == c || relay[w].parent == ROUTE_NONE || in_subtree[w]) continue;
+        double cost = relay[w].cost + link_cost(relay[w].x, relay[w].y, r->x, r->y);
+        if (cost < r->cost) route_set_parent(c, w, cost);
+    }
+    if (r->parent != ROUTE_NONE) heap_push(r->cost, c);
+}
+
+// 从堆中已有的种子出发做Dijkstra松弛，只会降低路径代价
+void route_propagate() {
+    static int neighbors[NUM_CLUSTERS];
+    while (route_heap_len > 0) {
+        HeapItem item = heap_pop();
+        int u = item.node;
+        if (item.cost > relay[u].cost) continue;
+        int n = relay_neighbors(relay[u].x, relay[u].y, neighbors);
+        for (int i = 0; i < n; ++i) {
+            int x = neighbors[i];
+            if (x == u) continue;
+            double cost = relay[u].cost + link_cost(relay[u].x, relay[u].y, relay[x].x, relay[x].y);
+            if (cost < relay[x].cost) {
+                route_set_parent(x, u, cost);
+                heap_push(cost, x);
             }
         }
     }
 }
 
+// 作废以c为根的子树，再从子树外的邻居重新接入
+void route_repair(int c) {
+    int n = 0, top = 0;
+    route_scratch[n++] = c;
+    while (top < n) {
+        int u = route_scratch[top++];
+        in_subtree[u] = true;
+        for (int v = relay[u].first_child; v != ROUTE_NONE && n < NUM_CLUSTERS; v = relay[v].next_sibling) {
+            route_scratch[n++] = v;
+        }
+    }
+
+    int* subtree = malloc(n * sizeof(int));
+    memcpy(subtree, route_scratch, n * sizeof(int));
+    for (int i = 0; i < n; ++i) route_set_parent(subtree[i], ROUTE_NONE, INFINITY);
+    for (int i = 0; i < n; ++i) {
+        if (relay[subtree[i]].alive) route_relax_from_neighbors(subtree[i]);
+    }
+    for (int i = 0; i < n; ++i) in_subtree[subtree[i]] = false;
+    free(subtree);
+    route_propagate();
+}
+
+// 簇头死亡：立即停止收发中继，缓冲里的包再也发不出去，记为丢弃；路由在下一时隙开始时修复
+void relay_head_down(int c) {
+    RelayState* r = &relay[c];
+    if (!r->alive) return;
+    r->alive = false;
+    r->dropped += r->queue_len;
+    r->queue_len = 0;
+    r->queue_first = 0;
+    relay_out->repair[relay_out->repair_num++] = c;
+}
+
+// 每个时隙结束时检查存活簇头的位置，移动了就在下一时隙开始时修复路由；
+// 与是否有包要转发、是否有路由无关
+void relay_check_moved(Cluster* cluster) {
+    RelayState* r = &relay[cluster->id];
+    if (!r->alive) return;
+    Node* head = &cluster->drones[r->head_index];
+    if (head->x != r->x || head->y != r->y) relay_out->repair[relay_out->repair_num++] = cluster->id;
+}
+
+// 时隙开始时处理上一时隙记下的簇：簇头移动的更新网格位置，然后重新计算它和它的子树，
+// 并向外传播可能的改进
+void relay_repair(Cluster clusters[], const int* list, int n) {
+    for (int i = 0; i < n; ++i) {
+        int c = list[i];
+        RelayState* r = &relay[c];
+        Node* head = &clusters[c].drones[r->head_index];
+        if (head->x != r->x || head->y != r->y) {
+            grid_remove(c);
+            r->x = head->x;
+            r->y = head->y;
+            grid_insert(c);
+        }
+        route_repair(c);
+    }
+}
+
+// 根据簇头位置建立网格并计算完整的路由树
+void relay_init(Cluster clusters[]) {
+    double min_x = sink_x, max_x = sink_x, min_y = sink_y, max_y = sink_y;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        RelayState* r = &relay[c];
+        memset(r, 0, sizeof(RelayState));
+        r->head_index = -1;
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            if (clusters[c].drones[d].is_head) {
+                r->head_index = d;
+                break;
+            }
+        }
+        r->alive = r->head_index >= 0 && !clusters[c].drones[r->head_index].is_dead;
+        if (r->head_index >= 0) {
+            r->x = clusters[c].drones[r->head_index].x;
+            r->y = clusters[c].drones[r->head_index].y;
+        }
+        r->parent = r->first_child = r->next_sibling = r->prev_sibling = r->next_in_cell = ROUTE_NONE;
+        r->cost = INFINITY;
+        if (r->x < min_x) min_x = r->x;
+        if (r->x > max_x) max_x = r->x;
+        if (r->y < min_y) min_y = r->y;
+        if (r->y > max_y) max_y = r->y;
+    }
+
+    // 格宽至少为通信距离，格数不超过1024x1024
+    double extent = fmax(max_x - min_x, max_y - min_y);
+    relay_grid.cell = fmax(RELAY_RANGE, extent / 1024);
+    relay_grid.min_x = min_x;
+    relay_grid.min_y = min_y;
+    relay_grid.nx = (int)((max_x - min_x) / relay_grid.cell) + 1;
+    relay_grid.ny = (int)((max_y - min_y) / relay_grid.cell) + 1;
+    free(relay_grid.first);
+    relay_grid.first = malloc(relay_grid.nx * relay_grid.ny * sizeof(int));
+    for (int i = 0; i < relay_grid.nx * relay_grid.ny; ++i) relay_grid.first[i] = ROUTE_NONE;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) grid_insert(c);
+
+    sink_first_child = ROUTE_NONE;
+    memset(&relay_main, 0, sizeof(relay_main));
+    route_updates = 0;
+
+    // 汇聚节点范围内的簇头作为种子，从汇聚节点出发跑一遍Dijkstra
+    int n = relay_neighbors(sink_x, sink_y, route_scratch);
+    for (int i = 0; i < n; ++i) {
+        int c = route_scratch[i];
+        route_set_parent(c, ROUTE_SINK, link_cost(relay[c].x, relay[c].y, sink_x, sink_y));
+        heap_push(relay[c].cost, c);
+    }
+    route_propagate();
+}
+
+// 放入簇头的中继缓冲，满则丢弃
+void relay_enqueue(int c, RelayPacket* packet) {
+    RelayState* r = &relay[c];
+    if (!r->alive || r->queue_len == RELAY_QUEUE_LEN) {
+        r->dropped++;
+        return;
+    }
+    r->queue[(r->queue_first + r->queue_len) % RELAY_QUEUE_LEN] = *packet;
+    r->queue_len++;
+}
 
+// 簇内成功收到的包交给簇头等待中继
+void relay_accept(Cluster* cluster, Packet* packet, int current_slot) {
+    RelayPacket relayed = {packet->arrival_slot, current_slot, 0, packet->cls};
+    relay_enqueue(cluster->id, &relayed);
+}
 
+// 簇头有待转发的包且有路由时占用信道做一次簇间交换
+bool relay_wants_channel(Cluster* cluster) {
+    RelayState* r = &relay[cluster->id];
+    return r->alive && r->queue_len > 0 && r->parent != ROUTE_NONE;
+}
 
+// CHANNEL_EXTRA交换完成：把最多RELAY_AGG_MAX个包交给下一跳（下一时隙生效）或汇聚节点
+void relay_forward(Cluster* cluster, int current_slot) {
+    RelayState* r = &relay[cluster->id];
+    RelayOutput* out = relay_out;
+    if (r->parent == ROUTE_NONE) return;
+
+    for (int i = 0; i < RELAY_AGG_MAX && r->queue_len > 0; ++i) {
+        RelayPacket packet = r->queue[r->queue_first];
+        r->queue_first = (r->queue_first + 1) % RELAY_QUEUE_LEN;
+        r->queue_len--;
+
+        histogram_add(&out->hop_delay, current_slot - packet.hop_slot);
+        packet.hops++;
+        packet.hop_slot = current_slot;
+        if (r->parent == ROUTE_SINK) {
+            histogram_add(&out->e2e_delay, current_slot - packet.origin_slot);
+            out->sink_delivered++;
+        } else {
+            out->pending[out->pending_num].dst = r->parent;
+            out->pending[out->pending_num].packet = packet;
+            out->pending_num++;
+        }
+    }
+}
 
+// 时隙开始时先修复路由，再把上一时隙转发出来的包放进下一跳的缓冲
+void relay_deliver(Cluster clusters[]) {
+    relay_repair(clusters, relay_main.repair, relay_main.repair_num);
+    relay_main.repair_num = 0;
+    for (int i = 0; i < relay_main.pending_num; ++i) relay_enqueue(relay_main.pending[i].dst, &relay_main.pending[i].packet);
+    relay_main.pending_num = 0;
+}
 
+void print_relay_statistics() {
+    long dropped = 0, buffered = 0;
+    int routed = 0;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        dropped += relay[c].dropped;
+        buffered += relay[c].queue_len;
+        if (relay[c].parent != ROUTE_NONE) routed++;
+    }
+    printf("Relay to sink (%.2f, %.2f): delivered: %ld, buffered: %ld, dropped: %ld, routed heads: %d/%d, route updates: %ld\n",
+           sink_x, sink_y, relay_main.sink_delivered, buffered, dropped, routed, NUM_CLUSTERS, route_updates);
+    print_histogram("Per-hop", &relay_main.hop_delay);
+    print_histogram("End-to-end", &relay_main.e2e_delay);
+}
 
 // 模拟结束后输出最终统计数据
-void print_final_statistics(Cluster clusters[]) {
+void print_final_statistics(Cluster clusters[], int slots) {
     printf("\n");
     printf("\n");
-    printf("Simulation ended after %d time slots.\n", TOTAL_TIME_SLOTS);
+    printf("Simulation ended after %d time slots.\n", slots);
     printf("--------------------------------------\n"); 
     printf("Final statistics after the entire simulation:\n");
     for (int c = 0; c < NUM_CLUSTERS; ++c) {
-        printf("(Cluster%d's intra Channel) total_packet: %d, total_idle_slot: %d, total_clash_slot: %d\n", clusters[c].id, total_packet[clusters[c].id], total_idle_slot[clusters[c].id], total_clash_slot[clusters[c].id]);
-        for (int d = 0; d < NUM_DRONES_PER_CLUSTER; ++d) {
+        printf("(Cluster%d's intra Channel) total_packet: %d, total_idle_slot: %d, total_clash_slot: %d\n", clusters[c].id, counters[clusters[c].id].packet, counters[clusters[c].id].idle_slot, counters[clusters[c].id].clash_slot);
+        for (int d = 0; d < clusters[c].node_num; ++d) {
             Node drone = clusters[c].drones[d];
             if(drone.total_delay_slot&&drone.total_sent_packet){
                 double avg_delaytime = (drone.total_delay_slot*SLOT_TIME)/drone.total_sent_packet;
@@ -210,7 +1236,16 @@ void print_final_statistics(Cluster clusters[]) {
 
         }
 
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            ClassStats* stats = &class_stats[clusters[c].id][k];
+            double avg_delaytime = stats->sent ? stats->delay_slot * SLOT_TIME / stats->sent : 0;
+            double throughput = stats->sent * PACKET_SIZE / (slots * SLOT_TIME);
+            printf("(Cluster%d class %s) arrived: %d, sent: %d, rejected: %d, preempted: %d, avg_delaytime: %.6fms throughput: %.6fb/ms\n",
+                   clusters[c].id, class_name[k], stats->arrived, stats->sent, stats->rejected, stats->preempted, avg_delaytime/1000, throughput*1000);
+        }
+
     }
+    if (relay_enabled) print_relay_statistics();
     printf("--------------------------------------\n"); 
 }
 
@@ -256,34 +1291,29 @@ int judge_clash(Cluster* cluster, int current_slot){
     return count;
 }
 
+// 能量等级：0/1/2 对应 ZREi_w = 1/2/3
+int energy_tier(int energy){
+    if (energy >= 0 && energy < R1 * MAX_ENERGY) return 2;
+    if (energy >= 0 && energy < R2 * MAX_ENERGY) return 1;
+    return 0;
+}
+
+// 根据队首包的优先级和剩余能量查表得到基础退避窗口，再按连续冲突次数翻倍，
+// 翻倍次数不超过该类别的上限（单位：BACKOFF_UNIT个时隙）
+int contention_window(Node* node){
+    int cls = node->queue_len ? node->queue[0].cls : CLASS_TELEMETRY;
+    int stage = node->back_off_stage < cw_max_stage[cls] ? node->back_off_stage : cw_max_stage[cls];
+    return cw_table[cls][energy_tier(node->energy)] << stage;
+}
+
 void back_off(Cluster* cluster, int current_slot){
     for (int j = 0; j < cluster->node_num; ++j) {
             if (cluster->drones[j].want_to_send && cluster->drones[j].id != cluster->head_id &&
                 cluster->drones[j].energy > 0 && cluster->drones[j].back_off_slot == 0) {
-                double RE_W = (double)cluster->drones[j].energy / 72;
-                char* DP = "01"; 
-                int CW_DP = 0;
-
-                if (strcmp(DP, "00") == 0) {
-                    CW_DP = CW_P1;
-                } else if (strcmp(DP, "01") == 0) {
-                    CW_DP = CW_P2;
-                } else {
-                    CW_DP = CW_P3;
-                }
-
-                int ZREi_w = 0;
-                if (0 <= RE_W && RE_W < R1) {
-                    ZREi_w = 3;
-                } else if (R1 <= RE_W && RE_W < R2) {
-                    ZREi_w = 2;
-                } else {
-                    ZREi_w = 1;
-                }
-
-                int tuibi_time = rand() % ((int)(CW_DP / pow(2, ZREi_w))) + 1;
-                cluster->drones[j].back_off_slot = tuibi_time * 8;
-                printf("drone %d back_off_slot %d\n",cluster->drones[j].id,cluster->drones[j].back_off_slot);
+                if (cluster->drones[j].back_off_stage < CW_MAX_STAGE) cluster->drones[j].back_off_stage++;
+                int tuibi_time = cluster_rand(cluster) % contention_window(&cluster->drones[j]) + 1;
+                cluster->drones[j].back_off_slot = tuibi_time * BACKOFF_UNIT;
+                SLOT_LOG("drone %d back_off_slot %d\n",cluster->drones[j].id,cluster->drones[j].back_off_slot);
             }
         }
 
@@ -308,15 +1338,15 @@ void send_rts(Cluster* cluster,Node* node, int current_slot){
         node->energy-=1;
         node->able_send = false;
 
-        printf("Drone %d at (%.2f, %.2f) in Cluster %d send rts\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Drone %d at (%.2f, %.2f) in Cluster %d send rts\n", node->id, node->x, node->y, cluster->id);
 
         cluster->channel.owner_id = node->id;
 
     }
     //判断是否发送成功
     if(RTS_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_RTS && cluster->channel.owner_id == node->id){
-        printf("Drone %d in Cluster %d successfully send rts\n", node->id, cluster->id);
-        total_rts[cluster->id]+=1;
+        SLOT_LOG("Drone %d in Cluster %d successfully send rts\n", node->id, cluster->id);
+        counters[cluster->id].rts+=1;
 
         cluster->channel.owner_id = node->id;
         cluster->channel.nch_id = node->id;
@@ -333,7 +1363,7 @@ void send_cts(Cluster* cluster,Node* node, int current_slot){
 
     if(cluster->channel.state == CHANNEL_CTS){
         node->energy -= 1;
-        printf("Cluster Head %d at (%.2f, %.2f) in Cluster %d send cts\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Cluster Head %d at (%.2f, %.2f) in Cluster %d send cts\n", node->id, node->x, node->y, cluster->id);
 
         cluster->channel.owner_id = node->id;
     }
@@ -343,9 +1373,9 @@ void send_cts(Cluster* cluster,Node* node, int current_slot){
 
     //判断是否发送成功
     if(CTS_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_CTS){
-        printf("Cluster Head %d in Cluster %d successfully send cts\n", node->id, cluster->id);
+        SLOT_LOG("Cluster Head %d in Cluster %d successfully send cts\n", node->id, cluster->id);
 
-        total_cts[cluster->id]+=1;
+        counters[cluster->id].cts+=1;
 
         cluster->channel.owner_id = node->id;
 
@@ -364,15 +1394,15 @@ void send_data(Cluster* cluster,Node* node, int current_slot){
     if(cluster->channel.nch_id == node->id && cluster->channel.state == CHANNEL_DATA){
         node->energy-=1;
 
-        printf("Drone %d at (%.2f, %.2f) in Cluster %d send data\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Drone %d at (%.2f, %.2f) in Cluster %d send data\n", node->id, node->x, node->y, cluster->id);
 
     }else{
         return;
     }
     //判断是否发送成功
     if(DATA_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_DATA){
-        printf("Drone %d in Cluster %d successfully send data\n", node->id, cluster->id);
-        total_data[cluster->id]+=1;
+        SLOT_LOG("Drone %d in Cluster %d successfully send data\n", node->id, cluster->id);
+        counters[cluster->id].data+=1;
 
     }
 
@@ -388,7 +1418,7 @@ void send_aci(Cluster* cluster,Node* node, int current_slot){
 
     if(cluster->channel.state == CHANNEL_ACI){//?nch_id==drone->id
         node->energy -= 1;
-        printf("Cluster Head %d at (%.2f, %.2f) in Cluster %d send aci\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Cluster Head %d at (%.2f, %.2f) in Cluster %d send aci\n", node->id, node->x, node->y, cluster->id);
 
     }
     else{
@@ -397,9 +1427,9 @@ void send_aci(Cluster* cluster,Node* node, int current_slot){
 
     //判断是否发送成功
     if(ACI_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_ACI){
-        printf("Cluster Head %d in Cluster %d successfully send aci\n", node->id, cluster->id);
+        SLOT_LOG("Cluster Head %d in Cluster %d successfully send aci\n", node->id, cluster->id);
 
-        total_aci[cluster->id]+=1;
+        counters[cluster->id].aci+=1;
 
         cluster->channel.owner_id = node->id;
 
@@ -416,7 +1446,7 @@ void send_beacon(Cluster* cluster,Node* node, int current_slot){
 
     if(cluster->channel.state == CHANNEL_BEACON){//?nch_id==drone->id
         node->energy -= 1;
-        printf("Cluster Head %d at (%.2f, %.2f) in Cluster %d send beacon\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Cluster Head %d at (%.2f, %.2f) in Cluster %d send beacon\n", node->id, node->x, node->y, cluster->id);
 
     }
     else{
@@ -425,9 +1455,9 @@ void send_beacon(Cluster* cluster,Node* node, int current_slot){
 
     //判断是否发送成功
     if(BEACON_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_BEACON){
-        printf("Cluster Head %d in Cluster %d successfully send beacon\n", node->id, cluster->id);
+        SLOT_LOG("Cluster Head %d in Cluster %d successfully send beacon\n", node->id, cluster->id);
 
-        total_beacon[cluster->id]+=1;
+        counters[cluster->id].beacon+=1;
 
         cluster->channel.owner_id = node->id;
 
@@ -446,21 +1476,50 @@ void send_packet(Cluster* cluster,Node* node, int current_slot){
     if(cluster->channel.nch_id == node->id && cluster->channel.state == CHANNEL_PACKET){
         node->energy-=1;
 
-        printf("Drone %d at (%.2f, %.2f) in Cluster %d send packet\n", node->id, node->x, node->y, cluster->id);
+        SLOT_LOG("Drone %d at (%.2f, %.2f) in Cluster %d send packet\n", node->id, node->x, node->y, cluster->id);
 
     }else{
         return;
     }
     //判断是否发送成功
-    if(PACKET_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_PACKET){
-        printf("Drone %d in Cluster %d successfully send packet\n", node->id, cluster->id);
-        total_packet[cluster->id]+=1;
+    //有包的簇头获胜时沿用旧的nch_id，那个成员可能没有包，或者队首包是交换开始之后才到的：
+    //这次交换只耗能量，不算投递。否则success_flag会留到它下一个包到达时，让新包以0时延"发出"
+    if(PACKET_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_PACKET
+       && node->want_to_send && current_slot - node->queue[0].arrival_slot >= CYCLE_SLOTS - 1){
+        SLOT_LOG("Drone %d in Cluster %d successfully send packet\n", node->id, cluster->id);
+        counters[cluster->id].packet+=1;
         node->success_flag = true;
 
     }
     
 }
 
+void send_extra(Cluster* cluster,Node* node, int current_slot){
+    //簇头才发簇间中继
+    if(!node->is_head)return;
+
+    if(!judge_energy(node))return;
+
+    if(cluster->channel.state == CHANNEL_EXTRA){
+        node->energy -= 1;
+        SLOT_LOG("Cluster Head %d at (%.2f, %.2f) in Cluster %d send extra\n", node->id, node->x, node->y, cluster->id);
+
+    }
+    else{
+        return;
+    }
+
+    //判断是否发送成功
+    if(EXTRA_SLOT == current_slot - cluster->channel.state_update_slot && cluster->channel.state == CHANNEL_EXTRA){
+        SLOT_LOG("Cluster Head %d in Cluster %d successfully send extra\n", node->id, cluster->id);
+
+        counters[cluster->id].extra+=1;
+        relay_forward(cluster, current_slot);
+
+    }
+
+}
+
 //没用
 void drone_sleep(Cluster* cluster,Node* node, int current_slot){
     if(node->is_head)return;
@@ -475,10 +1534,15 @@ void update_drone(Cluster* cluster,Node* node, int current_slot){
     send_aci(cluster,node,current_slot);
     send_beacon(cluster,node,current_slot);
     send_packet(cluster,node,current_slot);
+    send_extra(cluster,node,current_slot);
     drone_sleep(cluster,node,current_slot);
 
     //判断能量
     if(!judge_energy(node)){
+        if(!node->is_dead) {
+            counters[cluster->id].alive--;
+            if(node->is_head && relay_enabled) relay_head_down(cluster->id);
+        }
         node->is_dead = true;
         node->dead_slot = current_slot;
     }
@@ -486,21 +1550,27 @@ void update_drone(Cluster* cluster,Node* node, int current_slot){
     if(node->back_off_slot > 0) node->back_off_slot--;
 
     if(node->want_to_send){
-        if(node->delay_first){
-            node->start_slot = current_slot;
-            node->delay_first = false;
-        }
-        
+        node->start_slot = node->queue[0].arrival_slot;
+
         if(node->success_flag){
-            if(current_slot-node->start_slot>=8){
-                node->total_delay_slot += current_slot-node->start_slot;
+            int delay = current_slot - node->start_slot;
+            if(delay>=MIN_DELAY_SLOT){
+                node->total_delay_slot += delay;
                 node->total_sent_packet += 1;
                 node->total_throught_put += PACKET_SIZE;
             }
-            node->want_to_send = false;
-            node->delay_first = true;
+            ClassStats* stats = &class_stats[cluster->id][node->queue[0].cls];
+            stats->sent++;
+            stats->delay_slot += delay;
+            if (relay_enabled) relay_accept(cluster, &node->queue[0], current_slot);
+
+            //队首出队，后面的包紧接着竞争
+            node->queue_len--;
+            memmove(&node->queue[0], &node->queue[1], node->queue_len * sizeof(Packet));
+            node->want_to_send = node->queue_len > 0;
             node->able_send = false;
             node->success_flag = false;
+            node->back_off_stage = 0;
         }
     }
 
@@ -509,7 +1579,7 @@ void update_drone(Cluster* cluster,Node* node, int current_slot){
 
 void update_channel(Cluster* cluster, int current_slot){
     Channel* channel = &cluster->channel;
-    printf("channel state: %d\n",channel->state);
+    SLOT_LOG("channel state: %d\n",channel->state);
 
 
     if(channel->state == CHANNEL_RTS && RTS_SLOT == current_slot - channel->state_update_slot){
@@ -542,6 +1612,11 @@ void update_channel(Cluster* cluster, int current_slot){
         channel->state_update_slot = current_slot;
     }
 
+    if(channel->state == CHANNEL_EXTRA && EXTRA_SLOT == current_slot - channel->state_update_slot){
+        channel->state = CHANNEL_IDLE;
+        channel->state_update_slot = current_slot;
+    }
+
     if(channel->state == CHANNEL_IDLE || channel->state == CHANNEL_CLASH){
         channel->state_update_slot = current_slot;
     }
@@ -550,26 +1625,36 @@ void update_channel(Cluster* cluster, int current_slot){
 }
 
 void update_cluster(Cluster* cluster, int current_slot){
-    if (cluster->channel.state == CHANNEL_IDLE || cluster->channel.state == CHANNEL_CLASH)
+    bool contention = cluster->channel.state == CHANNEL_IDLE || cluster->channel.state == CHANNEL_CLASH;
+    if (contention && relay_enabled && relay_wants_channel(cluster))
+    {
+        //簇头有待中继的数据时优先占用信道做簇间交换，竞争节点的退避照常递减
+        SLOT_LOG("Cluster %d relay\n", cluster->id);
+        cluster->channel.state = CHANNEL_EXTRA;
+        cluster->channel.owner_id = cluster->drones[relay[cluster->id].head_index].id;
+    }
+    else if (contention)
     {
         //统计当前时隙下想要发数据的节点个数
         int clash_nums = judge_clash(cluster,current_slot);
+        counters[cluster->id].access += clash_nums;
 
 
         if(clash_nums>1){
             //发生冲突
-            printf("Cluster %d clash number: %d\n", cluster->id , clash_nums);
+            SLOT_LOG("Cluster %d clash number: %d\n", cluster->id , clash_nums);
 
             cluster->channel.state = CHANNEL_CLASH;
-            total_clash_slot[cluster->id]++;
+            counters[cluster->id].clash_slot++;
+            counters[cluster->id].clash_node += clash_nums;
             back_off(cluster, current_slot);
         }else if (clash_nums==1){
             cluster->channel.state = CHANNEL_RTS;
 
         }else{
-            printf("Cluster %d idle\n", cluster->id);
+            SLOT_LOG("Cluster %d idle\n", cluster->id);
             cluster->channel.state = CHANNEL_IDLE;
-            total_idle_slot[cluster->id]++;
+            counters[cluster->id].idle_slot++;
         }
         
     }
@@ -581,63 +1666,2555 @@ void update_cluster(Cluster* cluster, int current_slot){
     }
 
     update_channel(cluster,current_slot);
+    if (relay_enabled) relay_check_moved(cluster);
 
 
 
 }
 
 void show_slot_start(int slot_counter){
-    printf("--------------------------------------\n");
-    printf("Now is %d slot:\n", slot_counter);
+    SLOT_LOG("--------------------------------------\n");
+    SLOT_LOG("Now is %d slot:\n", slot_counter);
 }
 
 void show_slot_stop(){
-    printf("--------------------------------------\n");
-    printf("\n");
-    printf("\n");
+    SLOT_LOG("--------------------------------------\n");
+    SLOT_LOG("\n");
+    SLOT_LOG("\n");
 }
 
-// 处理整个TDMA通信模拟过程
-void simulate_tdma_communication(Cluster clusters[]) {
-    int slot_counter = 0; // 跟踪时隙的计数器
-    int round_counter = 0; // 跟踪轮次的计数器
+// 推进一个时隙
+void simulate_slot(Cluster clusters[], int slot_counter) {
+    show_slot_start(slot_counter);
 
-    while (slot_counter < TOTAL_TIME_SLOTS) { // 模拟循环
-        show_slot_start(slot_counter);
+    // 上一时隙记下的路由修复和转发出来的中继包在本时隙开始时生效
+    if (relay_enabled) relay_deliver(clusters);
 
-        // 每过一段时间随机模拟无人机想发数据
-        if (slot_counter % 10 == 0) random_want_to_send(clusters,slot_counter);
+    // 每过一段时间随机模拟无人机想发数据
+    if (slot_counter % want_period == 0) random_want_to_send(clusters,slot_counter);
 
-        // 更新当前时隙下的每个簇
-        for (int c = 0; c < NUM_CLUSTERS; ++c) {
-            update_cluster(&clusters[c], slot_counter);
-        }
+    // 更新当前时隙下的每个簇
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        update_cluster(&clusters[c], slot_counter);
+    }
 
-        slot_counter++;
-        show_slot_stop();   
+    show_slot_stop();
+}
 
-        if (slot_counter % 10 == 0) {
-            round_counter++;
-        }
+// ---------------- 状态哈希轨迹与差分测试 ----------------
+// 每个时隙结束后对全部簇的状态求一个64位哈希，优化过的引擎必须逐时隙与参考引擎一致。
+// 簇哈希之和与簇的处理顺序无关，分片并行的引擎也能按簇累加。
 
-        // 如果达到了总时隙数，结束模拟
-        if (slot_counter >= TOTAL_TIME_SLOTS) break;
-    }
+#define TRACE_MAGIC "TDMT"
+#define TRACE_VERSION 1
 
-    // 模拟结束后输出最终统计数据
-    print_final_statistics(clusters);
+FILE* trace_file = NULL;
 
+uint64_t hash_mix(uint64_t h, int64_t value) {
+    h ^= (uint64_t)value;
+    h *= 0x100000001b3ULL; // FNV-1a
+    return h;
 }
 
-int main() {
-    srand(time(NULL)); // 初始化随机数种子
+// 单个无人机在引擎中会变化的状态
+uint64_t hash_drone(const Node* node) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = hash_mix(h, node->id);
+    h = hash_mix(h, node->energy);
+    h = hash_mix(h, node->start_slot);
+    h = hash_mix(h, node->want_to_send);
+    h = hash_mix(h, node->able_send);
+    h = hash_mix(h, node->back_off_slot);
+    h = hash_mix(h, node->back_off_stage);
+    h = hash_mix(h, node->is_dead);
+    h = hash_mix(h, node->dead_slot);
+    h = hash_mix(h, node->total_delay_slot);
+    h = hash_mix(h, node->total_sent_packet);
+    h = hash_mix(h, node->success_flag);
+    h = hash_mix(h, node->queue_len);
+    for (int i = 0; i < node->queue_len; ++i) {
+        h = hash_mix(h, node->queue[i].cls);
+        h = hash_mix(h, node->queue[i].arrival_slot);
+    }
+    return h;
+}
+
+// 簇的信道、计数器、分类统计和中继状态（不含无人机）
+uint64_t hash_cluster_shared(const Cluster* cluster) {
+    const Channel* ch = &cluster->channel;
+    const ClusterCounters* cc = &counters[cluster->id];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = hash_mix(h, cluster->id);
+    h = hash_mix(h, ch->state);
+    h = hash_mix(h, ch->state_update_slot);
+    h = hash_mix(h, ch->owner_id);
+    h = hash_mix(h, ch->nch_id);
+    h = hash_mix(h, cc->idle_slot);
+    h = hash_mix(h, cc->clash_slot);
+    h = hash_mix(h, cc->rts);
+    h = hash_mix(h, cc->cts);
+    h = hash_mix(h, cc->data);
+    h = hash_mix(h, cc->aci);
+    h = hash_mix(h, cc->beacon);
+    h = hash_mix(h, cc->packet);
+    h = hash_mix(h, cc->extra);
+    h = hash_mix(h, cc->access);
+    h = hash_mix(h, cc->clash_node);
+    h = hash_mix(h, cc->alive);
+    for (int k = 0; k < NUM_CLASSES; ++k) {
+        const ClassStats* stats = &class_stats[cluster->id][k];
+        h = hash_mix(h, stats->arrived);
+        h = hash_mix(h, stats->rejected);
+        h = hash_mix(h, stats->preempted);
+        h = hash_mix(h, stats->sent);
+        h = hash_mix(h, stats->delay_slot);
+    }
+    if (relay_enabled) {
+        const RelayState* r = &relay[cluster->id];
+        h = hash_mix(h, r->queue_len);
+        h = hash_mix(h, r->dropped);
+        h = hash_mix(h, r->alive);
+        h = hash_mix(h, r->parent);
+        for (int i = 0; i < r->queue_len; ++i) {
+            const RelayPacket* p = &r->queue[(r->queue_first + i) % RELAY_QUEUE_LEN];
+            h = hash_mix(h, p->origin_slot);
+            h = hash_mix(h, p->hop_slot);
+            h = hash_mix(h, p->hops);
+        }
+    }
+    return h;
+}
+
+uint64_t hash_cluster(const Cluster* cluster) {
+    uint64_t h = hash_cluster_shared(cluster);
+    for (int d = 0; d < cluster->node_num; ++d) h = hash_mix(h, hash_drone(&cluster->drones[d]));
+    // 再做一次雪崩混合，使按簇求和不易抵消
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_state(Cluster clusters[]) {
+    uint64_t h = 0;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) h += hash_cluster(&clusters[c]);
+    return h;
+}
+
+bool open_trace(const char* path) {
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror(path);
+        return false;
+    }
+    uint32_t header[2] = {TRACE_VERSION, NUM_CLUSTERS};
+    fwrite(TRACE_MAGIC, 1, 4, trace_file);
+    fwrite(header, sizeof(header), 1, trace_file);
+    return true;
+}
+
+void write_trace(Cluster clusters[]) {
+    if (!trace_file) return;
+    uint64_t h = hash_state(clusters);
+    fwrite(&h, sizeof(h), 1, trace_file);
+}
+
+void close_trace() {
+    if (trace_file) fclose(trace_file);
+    trace_file = NULL;
+}
+
+// 读取轨迹文件，返回时隙数，出错返回-1
+long read_trace(const char* path, uint64_t** hashes) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    char magic[4];
+    uint32_t header[2];
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0 ||
+        fread(header, sizeof(header), 1, in) != 1 || header[0] != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(in);
+        return -1;
+    }
+    long cap = 1024, n = 0;
+    *hashes = malloc(cap * sizeof(uint64_t));
+    while (fread(&(*hashes)[n], sizeof(uint64_t), 1, in) == 1) {
+        if (++n == cap) {
+            cap *= 2;
+            *hashes = realloc(*hashes, cap * sizeof(uint64_t));
+        }
+    }
+    fclose(in);
+    return n;
+}
+
+// tracecmp：比较两个轨迹文件（可来自不同的构建），报告第一个不一致的时隙
+int compare_traces(const char* path_a, const char* path_b) {
+    uint64_t *a, *b;
+    long na = read_trace(path_a, &a);
+    if (na < 0) return 2;
+    long nb = read_trace(path_b, &b);
+    if (nb < 0) {
+        free(a);
+        return 2;
+    }
+    long n = na < nb ? na : nb, s = 0;
+    while (s < n && a[s] == b[s]) s++;
+    int rc = 0;
+    if (s < n) {
+        printf("Traces diverge at slot %ld\n", s);
+        rc = 1;
+    } else if (na != nb) {
+        printf("Traces agree on the first %ld slots but have different lengths (%ld vs %ld)\n", n, na, nb);
+        rc = 1;
+    } else {
+        printf("Traces identical over %ld slots\n", n);
+    }
+    free(a);
+    free(b);
+    return rc;
+}
+
+// 引擎变体：从当前状态推进slots个时隙，并在trace[s]中记录第s个时隙结束后的hash_state
+typedef void (*EngineRun)(Cluster clusters[], int slots, uint64_t* trace);
+
+typedef struct {
+    const char* name;
+    EngineRun run;
+} Engine;
+
+void run_reference(Cluster clusters[], int slots, uint64_t* trace) {
+    for (int s = 0; s < slots; ++s) {
+        simulate_slot(clusters, s);
+        if (trace) trace[s] = hash_state(clusters);
+    }
+}
+
+// ---------------- 分片并行引擎 ----------------
+// 簇按编号连续划分成若干分片，每个分片一个绑定到CPU核的工作线程。时隙内簇的竞争和收发只读写
+// 本簇的状态，簇之间只经由中继相互影响：转发出去的包和簇头死亡后的路由修复都记在RelayOutput里，
+// 下一时隙开始时才生效，即至少晚RTS_SLOT（最短帧长）。按这个前瞻量做保守同步：分片推进第s个
+// 时隙前只需确认其他分片都已完成第s-1个时隙，靠各分片发布的时钟判断，不用锁也不用屏障。
+// 跨分片的包经由每对分片之间的有界单生产者单消费者环形缓冲传递，接收方按源分片顺序取出，
+// 与单线程引擎按簇编号投递的顺序一致；需要修复路由时由0号分片按分片顺序修复，其他分片等它完成。
+// 本模型没有簇间干扰，不开中继时簇之间完全独立，分片之间不做任何同步。
+
+#define SHARD_MAX 256   // 分片数上限
+#define SHARD_SPIN 1024 // 等待时先自旋这么多次，再每次让出CPU
+
+// 跨分片的中继包：slot为转发时隙，接收方在slot+1开始时放入下一跳的缓冲
+typedef struct {
+    int slot;
+    RelayEvent event;
+} ShardMessage;
+
+// 有界SPSC环形缓冲：head只由消费者写，tail只由生产者写，各占一个缓存行
+typedef struct {
+    _Alignas(CACHE_LINE) uint32_t head;
+    _Alignas(CACHE_LINE) uint32_t tail;
+    _Alignas(CACHE_LINE) uint32_t mask;
+    ShardMessage* items;
+} ShardRing;
+
+typedef struct {
+    _Alignas(CACHE_LINE) int clock; // 已完成的时隙数；发布前本时隙的包和待修复的簇都已写好
+    int index;
+    int first, count;               // 负责的簇
+    Cluster* clusters;
+    int slots;
+    uint64_t* trace;
+    ShardRing* inbox;               // inbox[k]：分片k发来的包
+    RelayOutput* out;
+    int* repair[2];                 // 第s个时隙记下的待修复簇放在repair[s % 2]
+    int repair_num[2];
+    _Alignas(CACHE_LINE) int epoch; // 已响应的进度发布轮次，结束后为INT_MAX
+    int published_slot;             // 复制到shard_counters时已完成的时隙数
+} Shard;
+
+typedef struct {
+    int num;
+    Shard* shards;
+    int owner[NUM_CLUSTERS];                // 每个簇所在的分片
+    _Alignas(CACHE_LINE) int repaired;      // 0号分片完成第s个时隙开始时的路由修复后置为s
+    _Alignas(CACHE_LINE) int publish_epoch; // 主线程每STATS_PUBLISH_MS加一，请求各分片复制计数器
+} ShardSet;
+ShardSet shard_set;
+ClusterCounters shard_counters[NUM_CLUSTERS]; // 各分片在时隙边界复制出的计数器，供主线程发布
+int shard_count = 0;     // 分片数，0表示每个在线CPU一个
+bool shard_mode = false; // --shards：主模拟使用分片引擎
+
+// 等待*value不小于target
+void shard_wait(int* value, int target) {
+    for (int spins = 0; __atomic_load_n(value, __ATOMIC_ACQUIRE) < target; ++spins) {
+        if (spins >= SHARD_SPIN) sched_yield();
+    }
+}
+
+void ring_init(ShardRing* ring, uint32_t capacity) {
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+    ring->head = ring->tail = 0;
+    ring->mask = size - 1;
+    ring->items = malloc(size * sizeof(ShardMessage));
+}
+
+// 容量按两个时隙内源分片最多转发的包数分配，接收方最多落后一个时隙，所以不会真的等待
+void ring_push(ShardRing* ring, const ShardMessage* message) {
+    uint32_t tail = ring->tail;
+    for (int spins = 0; tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask; ++spins) {
+        if (spins >= SHARD_SPIN) sched_yield();
+    }
+    ring->items[tail & ring->mask] = *message;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 取队首，空则返回NULL
+const ShardMessage* ring_front(ShardRing* ring) {
+    uint32_t head = ring->head;
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->items[head & ring->mask];
+}
+
+void ring_pop(ShardRing* ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// 第s个时隙开始前：等其他分片完成第s-1个时隙，做完路由修复，再按源分片顺序取出上一时隙发来的包
+void shard_sync(Shard* shard, int s) {
+    Shard* shards = shard_set.shards;
+    int prev = (s - 1) % 2;
+    bool repair = false;
+    for (int k = 0; k < shard_set.num; ++k) {
+        shard_wait(&shards[k].clock, s);
+        if (shards[k].repair_num[prev] > 0) repair = true;
+    }
+    if (repair && shard->index == 0) {
+        for (int k = 0; k < shard_set.num; ++k) relay_repair(shard->clusters, shards[k].repair[prev], shards[k].repair_num[prev]);
+        __atomic_store_n(&shard_set.repaired, s, __ATOMIC_RELEASE);
+    } else if (repair) {
+        shard_wait(&shard_set.repaired, s);
+    }
+
+    for (int k = 0; k < shard_set.num; ++k) {
+        ShardRing* ring = &shard->inbox[k];
+        const ShardMessage* message;
+        while ((message = ring_front(ring)) && message->slot < s) {
+            RelayPacket packet = message->event.packet;
+            relay_enqueue(message->event.dst, &packet);
+            ring_pop(ring);
+        }
+    }
+}
+
+// 第s个时隙结束：把转发出去的包送进目标分片的环，记下待修复的簇
+void shard_publish(Shard* shard, int s) {
+    RelayOutput* out = shard->out;
+    for (int i = 0; i < out->pending_num; ++i) {
+        ShardMessage message = {s, out->pending[i]};
+        ring_push(&shard_set.shards[shard_set.owner[message.event.dst]].inbox[shard->index], &message);
+    }
+    memcpy(shard->repair[s % 2], out->repair, out->repair_num * sizeof(int));
+    shard->repair_num[s % 2] = out->repair_num;
+}
+
+// 时隙边界：主线程请求了新一轮进度发布就把本分片的计数器复制出去
+void shard_report(Shard* shard, int completed, int epoch) {
+    memcpy(&shard_counters[shard->first], &counters[shard->first], shard->count * sizeof(ClusterCounters));
+    shard->published_slot = completed;
+    __atomic_store_n(&shard->epoch, epoch, __ATOMIC_RELEASE);
+}
+
+// 工作线程运行期间由主线程定期发布进度：每轮等所有分片复制完计数器，
+// 时隙取各分片已完成时隙数的最小值。结束的分片最后复制一次并把epoch置为INT_MAX
+void shard_monitor() {
+    Shard* shards = shard_set.shards;
+    for (bool running = true; running;) {
+        struct timespec ts = {0, STATS_PUBLISH_MS * 1000000L};
+        nanosleep(&ts, NULL);
+        int epoch = __atomic_add_fetch(&shard_set.publish_epoch, 1, __ATOMIC_RELEASE);
+        int slot = INT_MAX;
+        running = false;
+        for (int k = 0; k < shard_set.num; ++k) {
+            shard_wait(&shards[k].epoch, epoch);
+            if (shards[k].epoch != INT_MAX) running = true;
+            if (shards[k].published_slot < slot) slot = shards[k].published_slot;
+        }
+        if (running) publish_snapshot(slot, shard_counters, false);
+    }
+}
+
+void* shard_main(void* arg) {
+    Shard* shard = arg;
+    relay_out = shard->out;
+    for (int s = 0; s < shard->slots; ++s) {
+        if (relay_enabled && s > 0) shard_sync(shard, s);
+        shard->out->pending_num = 0;
+        shard->out->repair_num = 0;
+
+        for (int c = shard->first; c < shard->first + shard->count; ++c) {
+            if (s % want_period == 0) cluster_want_to_send(&shard->clusters[c], s);
+            update_cluster(&shard->clusters[c], s);
+        }
+        if (shard->trace) {
+            uint64_t h = 0;
+            for (int c = shard->first; c < shard->first + shard->count; ++c) h += hash_cluster(&shard->clusters[c]);
+            __atomic_fetch_add(&shard->trace[s], h, __ATOMIC_RELAXED);
+        }
+
+        if (relay_enabled) shard_publish(shard, s);
+        __atomic_store_n(&shard->clock, s + 1, __ATOMIC_RELEASE);
+
+        int epoch = __atomic_load_n(&shard_set.publish_epoch, __ATOMIC_ACQUIRE);
+        if (epoch != shard->epoch) shard_report(shard, s + 1, epoch);
+    }
+    shard_report(shard, shard->slots, INT_MAX);
+    return NULL;
+}
+
+// 分片引擎：结果与run_reference逐时隙一致，结束后各分片的中继输出合并回relay_main
+void run_sharded(Cluster clusters[], int slots, uint64_t* trace) {
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    int n = shard_count > 0 ? shard_count : cpus;
+    if (n > NUM_CLUSTERS) n = NUM_CLUSTERS;
+    if (n > SHARD_MAX) n = SHARD_MAX;
+
+    bool saved_quiet = quiet_mode;
+    quiet_mode = true;
+    if (trace) memset(trace, 0, slots * sizeof(uint64_t));
+    // 第0个时隙开始时生效的中继事件由单线程引擎或之前的运行留下
+    if (relay_enabled && slots > 0) relay_deliver(clusters);
+
+    shard_set.num = n;
+    shard_set.repaired = 0;
+    shard_set.publish_epoch = 0;
+    shard_set.shards = aligned_alloc(CACHE_LINE, n * sizeof(Shard));
+    for (int k = 0; k < n; ++k) {
+        Shard* shard = &shard_set.shards[k];
+        memset(shard, 0, sizeof(Shard));
+        shard->index = k;
+        shard->first = (int)((long)k * NUM_CLUSTERS / n);
+        shard->count = (int)((long)(k + 1) * NUM_CLUSTERS / n) - shard->first;
+        shard->clusters = clusters;
+        shard->slots = slots;
+        shard->trace = trace;
+        shard->out = calloc(1, sizeof(RelayOutput));
+        for (int c = shard->first; c < shard->first + shard->count; ++c) shard_set.owner[c] = k;
+    }
+    if (relay_enabled) {
+        for (int k = 0; k < n; ++k) {
+            Shard* shard = &shard_set.shards[k];
+            shard->inbox = aligned_alloc(CACHE_LINE, n * sizeof(ShardRing));
+            for (int src = 0; src < n; ++src) {
+                ring_init(&shard->inbox[src], 2 * shard_set.shards[src].count * RELAY_AGG_MAX);
+            }
+            shard->repair[0] = malloc(sizeof(relay_main.repair));
+            shard->repair[1] = malloc(sizeof(relay_main.repair));
+        }
+    }
+
+    pthread_t threads[SHARD_MAX];
+    for (int k = 0; k < n; ++k) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(k % cpus, &cpu);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+        if (pthread_create(&threads[k], &attr, shard_main, &shard_set.shards[k]) != 0) {
+            // 绑定失败（比如受cgroup限制）时不绑核
+            pthread_create(&threads[k], NULL, shard_main, &shard_set.shards[k]);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (stats_segment.header) shard_monitor();
+    for (int k = 0; k < n; ++k) pthread_join(threads[k], NULL);
+
+    // 最后一个时隙的转发和待修复簇留给下一次推进；时延统计合并到relay_main
+    for (int k = 0; k < n; ++k) {
+        Shard* shard = &shard_set.shards[k];
+        RelayOutput* out = shard->out;
+        if (relay_enabled && slots > 0) {
+            memcpy(&relay_main.pending[relay_main.pending_num], out->pending, out->pending_num * sizeof(RelayEvent));
+            relay_main.pending_num += out->pending_num;
+            memcpy(&relay_main.repair[relay_main.repair_num], out->repair, out->repair_num * sizeof(int));
+            relay_main.repair_num += out->repair_num;
+        }
+        DelayHistogram* hists[2][2] = {{&relay_main.hop_delay, &out->hop_delay}, {&relay_main.e2e_delay, &out->e2e_delay}};
+        for (int h = 0; h < 2; ++h) {
+            hists[h][0]->count += hists[h][1]->count;
+            hists[h][0]->sum += hists[h][1]->sum;
+            for (int b = 0; b < HIST_BINS; ++b) hists[h][0]->bins[b] += hists[h][1]->bins[b];
+        }
+        relay_main.sink_delivered += out->sink_delivered;
+
+        if (shard->inbox) {
+            for (int src = 0; src < n; ++src) free(shard->inbox[src].items);
+            free(shard->inbox);
+        }
+        free(shard->repair[0]);
+        free(shard->repair[1]);
+        free(out);
+    }
+    free(shard_set.shards);
+    shard_set.shards = NULL;
+    quiet_mode = saved_quiet;
+}
+
+// scale [slots] [max_shards]：在当前参数生成的拓扑上按分片数加倍测速，并检查最终状态与参考引擎一致。
+// 分片数超过在线CPU数的部分只能说明分片本身的开销，加速比要在多核机器上量
+int shard_scaling(int slots, int max_shards) {
+    Cluster* clusters = alloc_clusters();
+    bool saved_quiet = quiet_mode;
+    quiet_mode = true;
+    int saved_count = shard_count;
+    int rc = 0;
+
+    // 0表示参考引擎，之后分片数按1, 2, 4, ...直到max_shards
+    int shard_counts[SHARD_MAX + 2], runs = 0;
+    shard_counts[runs++] = 0;
+    for (int n = 1; n < max_shards; n *= 2) shard_counts[runs++] = n;
+    shard_counts[runs++] = max_shards;
+
+    double reference_ms = 0, one_ms = 0;
+    uint64_t expected = 0;
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%d clusters, %d slots, relay %s, want_prob %.3f, online CPUs: %d\n", NUM_CLUSTERS, slots, relay_enabled ? "on" : "off",
+           want_prob, cpus);
+    if (max_shards > cpus) printf("(shard counts above the online CPU count measure overhead, not speedup)\n");
+    for (int i = 0; i < runs; ++i) {
+        int n = shard_counts[i];
+        srand(1);
+        initialize_clusters(clusters);
+        reset_statistics();
+        if (relay_enabled) relay_init(clusters);
+
+        double start = now_ms();
+        if (n == 0) {
+            run_reference(clusters, slots, NULL);
+        } else {
+            shard_count = n;
+            run_sharded(clusters, slots, NULL);
+        }
+        double ms = now_ms() - start;
+        uint64_t h = hash_state(clusters);
+
+        if (n == 0) {
+            reference_ms = ms;
+            expected = h;
+            printf("%10s %10.1fms %12.0f slots/s\n", "reference", ms, slots / ms * 1000);
+            continue;
+        }
+        if (n == 1) one_ms = ms;
+        printf("%3d shards %10.1fms %12.0f slots/s  %5.2fx vs 1 shard  %5.2fx vs reference  %s\n", n, ms, slots / ms * 1000,
+               one_ms / ms, reference_ms / ms, h == expected ? "state identical" : "STATE DIFFERS");
+        if (h != expected) rc = 1;
+    }
+
+    shard_count = saved_count;
+    quiet_mode = saved_quiet;
+    free(clusters);
+    return rc;
+}
+
+Engine engines[] = {
+    {"reference", run_reference},
+    {"sharded", run_sharded},
+};
+#define NUM_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+Engine* find_engine(const char* name) {
+    for (int i = 0; i < NUM_ENGINES; ++i) {
+        if (strcmp(engines[i].name, name) == 0) return &engines[i];
+    }
+    return NULL;
+}
+
+// 按种子生成随机场景：负载、业务构成、中继、簇大小和低能量节点都随机
+void random_scenario(Cluster clusters[], unsigned seed) {
+    static const int periods[] = {1, 5, 10, 20};
+    srand(seed);
+    want_period = periods[rand() % 4];
+    want_prob = 0.01 + (rand() % 100) / 100.0;
+    double mix[NUM_CLASSES];
+    double sum = 0;
+    for (int k = 0; k < NUM_CLASSES; ++k) sum += mix[k] = rand() % 10 + 1;
+    for (int k = 0; k < NUM_CLASSES; ++k) default_mix[k] = mix[k] / sum;
+    relay_enabled = rand() % 2;
+    sink_x = rand() % ((NUM_CLUSTERS + 1) * 1000);
+    sink_y = rand() % ((NUM_CLUSTERS + 1) * 1000);
 
-    Cluster clusters[NUM_CLUSTERS];
     initialize_clusters(clusters);
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        init_cluster(&clusters[c], c, 2 + rand() % (NUM_DRONES_PER_CLUSTER - 1));
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            // 部分节点能量很低，覆盖能量分级和死亡的路径
+            if (rand() % 4 == 0) clusters[c].drones[d].energy = 2 + rand() % 20;
+        }
+    }
+    reset_statistics();
+    if (relay_enabled) relay_init(clusters);
+}
+
+// 引擎运行后的完整状态，用于定位不一致的簇和无人机
+typedef struct {
+    Cluster clusters[NUM_CLUSTERS];
+    ClusterCounters counters[NUM_CLUSTERS];
+    ClassStats class_stats[NUM_CLUSTERS][NUM_CLASSES];
+    RelayState relay[NUM_CLUSTERS];
+} EngineSnapshot;
+
+void take_snapshot(EngineSnapshot* snap, Cluster clusters[]) {
+    memcpy(snap->clusters, clusters, sizeof(snap->clusters));
+    memcpy(snap->counters, counters, sizeof(snap->counters));
+    memcpy(snap->class_stats, class_stats, sizeof(snap->class_stats));
+    memcpy(snap->relay, relay, sizeof(snap->relay));
+}
+
+void restore_snapshot(EngineSnapshot* snap) {
+    memcpy(counters, snap->counters, sizeof(counters));
+    memcpy(class_stats, snap->class_stats, sizeof(class_stats));
+    memcpy(relay, snap->relay, sizeof(relay));
+}
+
+void print_drone_diff(const Node* a, const Node* b) {
+#define DIFF_FIELD(field) \
+    if (a->field != b->field) printf("    %s: %d vs %d\n", #field, (int)a->field, (int)b->field)
+    DIFF_FIELD(energy);
+    DIFF_FIELD(start_slot);
+    DIFF_FIELD(want_to_send);
+    DIFF_FIELD(able_send);
+    DIFF_FIELD(back_off_slot);
+    DIFF_FIELD(back_off_stage);
+    DIFF_FIELD(is_dead);
+    DIFF_FIELD(dead_slot);
+    DIFF_FIELD(total_delay_slot);
+    DIFF_FIELD(total_sent_packet);
+    DIFF_FIELD(success_flag);
+    DIFF_FIELD(queue_len);
+#undef DIFF_FIELD
+}
+
+// 两个引擎都从同一场景推进到第slot个时隙为止，找出第一个状态不同的簇和无人机
+void locate_divergence(Cluster clusters[], Engine* ref, Engine* variant, unsigned seed, int slot, EngineSnapshot* a,
+                       EngineSnapshot* b) {
+    random_scenario(clusters, seed);
+    ref->run(clusters, slot + 1, NULL);
+    take_snapshot(a, clusters);
+    random_scenario(clusters, seed);
+    variant->run(clusters, slot + 1, NULL);
+    take_snapshot(b, clusters);
+
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        restore_snapshot(a);
+        uint64_t shared_a = hash_cluster_shared(&a->clusters[c]);
+        restore_snapshot(b);
+        uint64_t shared_b = hash_cluster_shared(&b->clusters[c]);
+        for (int d = 0; d < a->clusters[c].node_num; ++d) {
+            const Node* na = &a->clusters[c].drones[d];
+            const Node* nb = &b->clusters[c].drones[d];
+            if (hash_drone(na) != hash_drone(nb)) {
+                printf("  first diverging drone: %d in cluster %d (%s vs %s)\n", na->id, c, ref->name, variant->name);
+                print_drone_diff(na, nb);
+                return;
+            }
+        }
+        if (shared_a != shared_b) {
+            printf("  cluster %d channel/counters/relay state diverged (channel state %d vs %d, owner %d vs %d)\n", c,
+                   a->clusters[c].channel.state, b->clusters[c].channel.state, a->clusters[c].channel.owner_id,
+                   b->clusters[c].channel.owner_id);
+            return;
+        }
+    }
+    printf("  no per-cluster difference found; divergence is in state outside the clusters\n");
+}
+
+// diff：在随机场景上逐时隙比较引擎变体与参考引擎
+int differential_test(const char* variant_name, int scenarios, int slots) {
+    Engine* ref = find_engine("reference");
+    Engine* variant = find_engine(variant_name);
+    if (!variant) {
+        fprintf(stderr, "unknown engine %s; available:", variant_name);
+        for (int i = 0; i < NUM_ENGINES; ++i) fprintf(stderr, " %s", engines[i].name);
+        fprintf(stderr, "\n");
+        return 2;
+    }
+
+    Cluster* clusters = alloc_clusters();
+    uint64_t* trace_a = malloc(slots * sizeof(uint64_t));
+    uint64_t* trace_b = malloc(slots * sizeof(uint64_t));
+    EngineSnapshot* a = malloc(sizeof(EngineSnapshot));
+    EngineSnapshot* b = malloc(sizeof(EngineSnapshot));
+    bool saved_quiet = quiet_mode;
+    int failed = 0;
+    quiet_mode = true;
+
+    for (int i = 0; i < scenarios; ++i) {
+        unsigned seed = i + 1;
+        random_scenario(clusters, seed);
+        ref->run(clusters, slots, trace_a);
+        random_scenario(clusters, seed);
+        variant->run(clusters, slots, trace_b);
+
+        int s = 0;
+        while (s < slots && trace_a[s] == trace_b[s]) s++;
+        if (s == slots) continue;
+        failed++;
+        printf("seed %u: %s diverges from %s at slot %d\n", seed, variant->name, ref->name, s);
+        locate_divergence(clusters, ref, variant, seed, s, a, b);
+    }
+
+    printf("%s vs %s: %d/%d scenarios identical over %d slots\n", variant->name, ref->name, scenarios - failed,
+           scenarios, slots);
+    quiet_mode = saved_quiet;
+    free(clusters);
+    free(trace_a);
+    free(trace_b);
+    free(a);
+    free(b);
+    return failed ? 1 : 0;
+}
+
+// ---------------- 序贯停止的收敛检测 ----------------
+// 把吞吐量和时延按批次求均值，批次数满CONV_BATCHES后两两合并、批长翻倍。
+// 每完成一批就用MSER规则截掉初始暂态，再按批均值的一阶自相关修正方差，
+// 两个指标的相对置信区间半宽都小于目标时提前结束。
+// 节点耗尽能量会改变稳态，但能耗持续的网络里死亡一直在发生，不能要求估计窗口内没有死亡：
+// 死亡不丢弃已有批次，它造成的水平变化和初始暂态一样由MSER截掉，估计的是当前存活集合下的稳态。
+// 均值接近0（例如只剩冲突的活锁）时相对半宽没有意义，改用相对信道容量的绝对容差。
+// 所有簇都无法再投递（簇头或全部成员死亡）时吞吐量恒为0，这是吸收态，直接结束并报告。
+
+#define CONV_BATCHES 64     // 保留的批次数上限
+#define CONV_BATCH_SLOTS 16 // 初始批长（时隙）
+#define CONV_MIN_BATCHES 10 // 截断后至少要有的批次数
+#define CONV_MAX_FACTOR 100 // 未指定--max-slots时，最多运行TOTAL_TIME_SLOTS的这么多倍
+#define CONV_ABS_FLOOR 0.01 // 吞吐量的绝对容差：半宽不超过target乘以全网信道容量的这个比例即可
+
+typedef struct {
+    bool enabled;
+    double target;      // 相对半宽目标（如0.05表示±5%）
+    int max_slots;
+    int batch_slots;    // 当前批长
+    int k;              // 已完成的批次数
+    double thr[CONV_BATCHES];     // 每批吞吐量（b/us）
+    double delay_sum[CONV_BATCHES];
+    long delay_count[CONV_BATCHES];
+    long access[CONV_BATCHES];    // 每批的发送尝试数，区分活锁和还没有包
+    // 当前批的累加
+    int cur_slots;
+    long cur_packets;
+    long cur_access;
+    double cur_delay;
+    long cur_count;
+    // 上一时隙结束时的累计值
+    long last_packets;
+    long last_access;
+    long last_sent;
+    long last_delay;
+    int alive;          // 当前的存活节点数
+    int regimes;        // 存活节点集合变化的次数
+    int last_change;    // 最近一次变化的时隙
+    // 结果
+    bool converged;
+    bool absorbed;      // 所有簇都已无法投递
+    int stop_slot;
+    int transient_slots;
+    double thr_mean, thr_hw;
+    double delay_mean, delay_hw; // 单位时隙
+    bool idle;                   // 吞吐量收敛到0，没有可估计的时延
+} Convergence;
+Convergence convergence;
+
+// 自由度为df的t分布0.975分位数（Cornish-Fisher近似）
+double t_quantile(int df) {
+    double z = 1.959964;
+    return z + (z * z * z + z) / (4.0 * df) + (5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96.0 * df * df);
+}
+
+// 对批均值序列做MSER截断并估计均值和95%置信区间半宽，批次不够时返回false
+bool series_estimate(const double* x, int k, double* mean, double* hw, int* truncated) {
+    if (k < CONV_MIN_BATCHES) return false;
+
+    // MSER：选使 Σ(x_i - mean_d)^2 / (k-d)^2 最小的截断点d（d <= k/2）
+    double best = INFINITY;
+    int best_d = 0;
+    double sum = 0, sq = 0;
+    for (int i = k - 1; i >= 0; --i) {
+        sum += x[i];
+        sq += x[i] * x[i];
+        int n = k - i;
+        if (i <= k / 2) {
+            double ss = sq - sum * sum / n;
+            double score = ss / ((double)n * n);
+            if (score <= best) {
+                best = score;
+                best_d = i;
+            }
+        }
+    }
+
+    // 截断点落在允许范围的边界上说明暂态还没结束
+    if (best_d == k / 2) return false;
+    int n = k - best_d;
+    if (n < CONV_MIN_BATCHES) return false;
+    double m = 0;
+    for (int i = best_d; i < k; ++i) m += x[i];
+    m /= n;
+    double var = 0, cov = 0;
+    for (int i = best_d; i < k; ++i) {
+        var += (x[i] - m) * (x[i] - m);
+        if (i + 1 < k) cov += (x[i] - m) * (x[i + 1] - m);
+    }
+    // 批均值仍相关时按AR(1)放大方差
+    double rho = var > 0 ? cov / var : 0;
+    if (rho >= 0.99) return false;
+    double inflate = rho > 0 ? (1 + rho) / (1 - rho) : 1;
+    var /= n - 1;
+
+    *mean = m;
+    *hw = t_quantile(n - 1) * sqrt(var * inflate / n);
+    *truncated = best_d;
+
+    // 缓慢的趋势（队列还在变长、能量等级在变）MSER截不掉：前后两半的均值差超过半宽的两倍
+    // （两半之差的标准误约为整体的两倍）时认为还在漂移
+    double first = 0, second = 0;
+    int half = n / 2;
+    for (int i = 0; i < half; ++i) first += x[best_d + i];
+    for (int i = half; i < n; ++i) second += x[best_d + i];
+    if (fabs(first / half - second / (n - half)) > 2 * *hw) return false;
+    return true;
+}
+
+void convergence_init(double target, int max_slots) {
+    memset(&convergence, 0, sizeof(convergence));
+    convergence.enabled = true;
+    convergence.target = target;
+    convergence.max_slots = max_slots;
+    convergence.batch_slots = CONV_BATCH_SLOTS;
+    convergence.alive = -1;
+}
+
+// 统计存活节点数，deliverable返回仍能投递的簇数（簇头和至少一个成员存活）
+int alive_population(Cluster clusters[], int* deliverable) {
+    int alive = 0;
+    *deliverable = 0;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        bool head = false, member = false;
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            Node* node = &clusters[c].drones[d];
+            if (!judge_energy(node)) continue;
+            alive++;
+            if (node->is_head) head = true;
+            else member = true;
+        }
+        if (head && member) (*deliverable)++;
+    }
+    return alive;
+}
+
+// 批均值按批次等权，包很少的批次和包很多的批次一样重，时延的区间很宽。截断点由MSER定出后，
+// 改用按包加权的比率估计 Σ时延/Σ包数，方差按delta方法由残差 d_i - R·n_i 得到。
+// 和series_estimate一样检查前后两半是否一致，还在漂移时返回false
+bool ratio_estimate(Convergence* cv, int first, double* mean, double* hw) {
+    double sum = 0, count = 0;
+    int n = cv->k - first;
+    for (int i = first; i < cv->k; ++i) {
+        sum += cv->delay_sum[i];
+        count += cv->delay_count[i];
+    }
+    double r = sum / count, var = 0;
+    for (int i = first; i < cv->k; ++i) {
+        double z = cv->delay_sum[i] - r * cv->delay_count[i];
+        var += z * z;
+    }
+    var /= n - 1;
+    *mean = r;
+    *hw = t_quantile(n - 1) * sqrt(var * n) / count;
+
+    double part_sum[2] = {0}, part_count[2] = {0};
+    for (int i = first; i < cv->k; ++i) {
+        part_sum[i - first >= n / 2] += cv->delay_sum[i];
+        part_count[i - first >= n / 2] += cv->delay_count[i];
+    }
+    if (part_count[0] == 0 || part_count[1] == 0) return false;
+    return fabs(part_sum[0] / part_count[0] - part_sum[1] / part_count[1]) <= 2 * *hw;
+}
+
+// 完成一批后检查是否收敛
+bool convergence_check(int slot) {
+    Convergence* cv = &convergence;
+    double delay[CONV_BATCHES];
+    int index[CONV_BATCHES]; // delay[j]对应的批次
+    int nd = 0;
+    for (int i = 0; i < cv->k; ++i) {
+        if (cv->delay_count[i] > 0) {
+            index[nd] = i;
+            delay[nd++] = cv->delay_sum[i] / cv->delay_count[i];
+        }
+    }
+
+    int thr_cut, delay_cut = 0;
+    if (!series_estimate(cv->thr, cv->k, &cv->thr_mean, &cv->thr_hw, &thr_cut)) return false;
+    double capacity = NUM_CLUSTERS * PACKET_SIZE / (CYCLE_SLOTS * SLOT_TIME);
+    double tolerance = cv->target * fmax(fabs(cv->thr_mean), CONV_ABS_FLOOR * capacity);
+    if (cv->thr_hw > tolerance) return false;
+    // 吞吐量在容差内为0、而每批都有节点在竞争（活锁）时几乎没有包送达，时延批次凑不够，只报告吞吐量；
+    // 还没有包到达时不算
+    bool contended = true;
+    for (int i = thr_cut; i < cv->k; ++i) {
+        if (cv->access[i] == 0) contended = false;
+    }
+    cv->idle = contended && fabs(cv->thr_mean) + cv->thr_hw <= tolerance && nd < CONV_MIN_BATCHES;
+    if (!cv->idle) {
+        if (!series_estimate(delay, nd, &cv->delay_mean, &cv->delay_hw, &delay_cut)) return false;
+        if (!ratio_estimate(cv, index[delay_cut], &cv->delay_mean, &cv->delay_hw)) return false;
+        delay_cut = index[delay_cut];
+        if (cv->delay_mean <= 0 || cv->delay_hw / cv->delay_mean > cv->target) return false;
+    }
+    cv->transient_slots = (thr_cut > delay_cut ? thr_cut : delay_cut) * cv->batch_slots;
+
+    cv->converged = true;
+    cv->stop_slot = slot;
+    return true;
+}
+
+// 每个时隙结束后调用，收敛或进入吸收态时返回true
+bool convergence_observe(Cluster clusters[], int slot) {
+    Convergence* cv = &convergence;
+    long packets = 0, sent = 0, delay = 0, access = 0;
+    int deliverable;
+    int alive = alive_population(clusters, &deliverable);
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        packets += counters[c].packet;
+        access += counters[c].access;
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            sent += class_stats[c][k].sent;
+            delay += class_stats[c][k].delay_slot;
+        }
+    }
+    cv->cur_packets += packets - cv->last_packets;
+    cv->cur_count += sent - cv->last_sent;
+    cv->cur_delay += delay - cv->last_delay;
+    cv->cur_access += access - cv->last_access;
+    cv->last_packets = packets;
+    cv->last_access = access;
+    cv->last_sent = sent;
+    cv->last_delay = delay;
+    if (deliverable == 0) {
+        cv->absorbed = true;
+        cv->stop_slot = slot;
+        return true;
+    }
+    if (alive != cv->alive) {
+        if (cv->alive >= 0) {
+            cv->regimes++;
+            cv->last_change = slot;
+        }
+        cv->alive = alive;
+    }
+    if (++cv->cur_slots < cv->batch_slots) return false;
+
+    if (cv->k == CONV_BATCHES) {
+        for (int i = 0; i < CONV_BATCHES / 2; ++i) {
+            cv->thr[i] = (cv->thr[2 * i] + cv->thr[2 * i + 1]) / 2;
+            cv->delay_sum[i] = cv->delay_sum[2 * i] + cv->delay_sum[2 * i + 1];
+            cv->delay_count[i] = cv->delay_count[2 * i] + cv->delay_count[2 * i + 1];
+            cv->access[i] = cv->access[2 * i] + cv->access[2 * i + 1];
+        }
+        cv->k = CONV_BATCHES / 2;
+        cv->batch_slots *= 2;
+        // 当前批只有旧批长的一半，延长到新批长后再记录
+        return false;
+    }
+
+    cv->thr[cv->k] = cv->cur_packets * PACKET_SIZE / (cv->cur_slots * SLOT_TIME);
+    cv->delay_sum[cv->k] = cv->cur_delay;
+    cv->delay_count[cv->k] = cv->cur_count;
+    cv->access[cv->k] = cv->cur_access;
+    cv->k++;
+    cv->cur_slots = 0;
+    cv->cur_packets = 0;
+    cv->cur_delay = 0;
+    cv->cur_count = 0;
+    cv->cur_access = 0;
+    return convergence_check(slot);
+}
+
+void print_convergence(int slots) {
+    Convergence* cv = &convergence;
+    if (cv->absorbed) {
+        printf("Absorbed after %d slots: no cluster has both a live head and a live member, throughput is 0 from here on\n",
+               slots);
+    } else if (cv->converged) {
+        printf("Converged after %d slots (target ±%.1f%%, %d batches of %d slots, transient: %d slots discarded)\n",
+               slots, cv->target * 100, cv->k, cv->batch_slots, cv->transient_slots);
+    } else {
+        printf("Not converged within %d slots (target ±%.1f%%)\n", slots, cv->target * 100);
+    }
+    if (cv->regimes > 0) {
+        printf("Alive population changed %d times (last at slot %d); %d drones alive at the end\n", cv->regimes,
+               cv->last_change, cv->alive);
+    }
+    if (cv->converged && cv->idle) {
+        printf("Steady-state throughput: %.6fb/us ± %.6f, no packets delivered, delay undefined\n", cv->thr_mean,
+               cv->thr_hw);
+    } else if (cv->converged) {
+        printf("Steady-state throughput: %.6fb/us ± %.6f, delay: %.6fms ± %.6f\n", cv->thr_mean, cv->thr_hw,
+               cv->delay_mean * SLOT_TIME / 1000, cv->delay_hw * SLOT_TIME / 1000);
+    }
+    printf("Saved %d of %d slots (%.1f%%) against --max-slots\n", cv->max_slots - slots, cv->max_slots,
+           100.0 * (cv->max_slots - slots) / cv->max_slots);
+}
+
+// 处理整个TDMA通信模拟过程，返回实际模拟的时隙数
+int simulate_tdma_communication(Cluster clusters[]) {
+    int slot_counter = 0; // 跟踪时隙的计数器
+    int round_counter = 0; // 跟踪轮次的计数器
+    int total_slots = convergence.enabled ? convergence.max_slots : TOTAL_TIME_SLOTS;
+
+    if (shard_mode) {
+        // 分片引擎一次推进全部时隙，轨迹在结束后写出
+        uint64_t* trace = trace_file ? malloc(total_slots * sizeof(uint64_t)) : NULL;
+        run_sharded(clusters, total_slots, trace);
+        if (trace) fwrite(trace, sizeof(uint64_t), total_slots, trace_file);
+        free(trace);
+        slot_counter = total_slots;
+        publish_stats(slot_counter, true);
+    }
+
+    while (slot_counter < total_slots) { // 模拟循环
+        simulate_slot(clusters, slot_counter);
+        slot_counter++;
+        publish_stats(slot_counter, false);
+        write_trace(clusters);
+
+        if (slot_counter % 10 == 0) {
+            round_counter++;
+        }
+
+        // 收敛模式下置信区间足够窄就提前结束
+        if (convergence.enabled && convergence_observe(clusters, slot_counter)) break;
+
+        // 如果达到了总时隙数，结束模拟
+        if (slot_counter >= total_slots) break;
+    }
+
+    // 模拟结束后输出最终统计数据
+    print_final_statistics(clusters, slot_counter);
+    if (convergence.enabled) print_convergence(slot_counter);
+
+    return slot_counter;
+}
+
+// ---------------- 寿命模式：自适应时隙粗化 ----------------
+// 网络寿命需要模拟很多时隙，其中大部分时间各节点的能耗和收发速率是平稳的。
+// 混合模式按窗口逐时隙模拟，窗口内统计量的增量累加到当前"工况"中；能耗速率稳定后，
+// 按工况内测得的速率抽样出下一个"关键事件"，把统计量外推到该事件发生的时隙并施加它。
+// 关键事件是某架无人机做了之后可能致死的那次交换、空闲簇头来包、有包簇头的簇里nch_id改变，
+// 跳到事件为止保证节点死亡（竞争节点集合改变）只在逐时隙模拟中发生，之后工况重新开始累计。
+// 只有冲突、没有一次RTS成功的活锁是能耗为0的稳定工况，交换次数为0也允许跳跃。
+// 簇内没有存活节点有包时信道空闲、没有能耗，直接重放到达抽样，整段快进到下一个包到达，与逐时隙模拟逐位一致。
+// 工况分成较早和较新两段，两段的交换速率在统计上一致且交换次数足够才算稳定。较新一段
+// 和较早一段一样长时，一致就合并，不一致就丢弃较早一段，所以暂态（比如从正常收发进入活锁）
+// 会很快被丢掉，平稳时工况越来越长。
+// 单架无人机一生只有十几次交换，单独估计速率噪声太大，所以同一簇内同一角色（簇头/成员）
+// 的无人机合并估计速率，跳跃时每架无人机的交换次数按该速率做泊松抽样。
+// 不开中继时簇之间互不影响，每个簇是一个独立的组，有自己的时钟，各自粗化；
+// 开中继时所有簇组成一个组，按simulate_slot推进。
+
+#define LIFETIME_WINDOW 512       // 检测窗口的基准长度（时隙），向上取整到CYCLE_SLOTS和want_period的公倍数
+#define LIFETIME_MIN_WINDOWS 4    // 工况至少累计这么多个窗口才允许跳跃
+#define LIFETIME_MIN_EVENTS 20    // 每个角色合并后至少观测到的交换次数（没有能耗的角色除外）
+#define LIFETIME_Z 2.0            // 两段速率之差超过这么多个标准差就认为还不平稳
+#define LIFETIME_GUARD 5          // 跳跃后距离死亡阈值至少保留的能量
+#define LIFETIME_MAX_WINDOWS 1024 // 一次跳跃最多跨过的窗口数
+#define LIFETIME_MAX_SLOTS 20000000 // 默认最多模拟的时隙数
+
+// 一次成功交换的能耗：成员发RTS、DATA、PACKET，簇头发CTS、ACI、BEACON，每个时隙耗1
+#define MEMBER_EXCHANGE_ENERGY (RTS_SLOT + DATA_SLOT + PACKET_SLOT)
+#define HEAD_EXCHANGE_ENERGY (CTS_SLOT + ACI_SLOT + BEACON_SLOT)
+
+// 每个簇的计数器中参与外推的字段（alive之前的全部int32_t字段）
+#define COUNTER_FIELDS (int)(offsetof(ClusterCounters, alive) / sizeof(int32_t))
+// 每个簇参与外推的统计量个数，以及开中继时全局的中继统计量个数
+#define CLUSTER_TALLY_LEN (COUNTER_FIELDS + NUM_CLASSES * 5 + NUM_DRONES_PER_CLUSTER * 4 + 1)
+#define RELAY_TALLY_LEN (2 * (HIST_BINS + 2) + 1)
+// 第d架无人机的能量在簇统计量中的位置
+#define TALLY_ENERGY(d) (COUNTER_FIELDS + NUM_CLASSES * 5 + (d) * 4)
+#define TALLY_SENT(d) (TALLY_ENERGY(d) + 2)
+
+typedef struct {
+    int first_death;    // 第一架无人机死亡的时隙，-1表示没有发生
+    int half_death;     // 一半无人机死亡的时隙
+    int network_death;  // 所有簇都失去簇头或全部成员的时隙
+    int slots;          // 模拟到的时隙（含跳过的）
+    long cluster_slots; // 各簇推进的时隙数之和
+    long detail_slots;  // 其中逐时隙模拟的部分
+    int jumps;
+    double wall_ms;
+} LifetimeResult;
+
+// 一组共同推进的簇
+typedef struct {
+    int first, count;
+    int clock;          // 组内已完成的时隙数
+    int alive;          // 组内存活的无人机数，变化时工况重新开始
+    int live_clusters;  // 组内还能收发的簇数
+    long detail_slots;
+    int jumps;
+    int tally_len;
+    double* mark;       // 当前窗口开始时的统计量
+    double* now;
+    double* older;      // 工况中较早一段的累计增量
+    double* newer;      // 工况中较新一段的累计增量
+    long older_slots, newer_slots;
+} LifetimeGroup;
+
+typedef struct {
+    bool coarsen;
+    int window;
+    int death_slot[NUM_CLUSTERS][NUM_DRONES_PER_CLUSTER];
+    int cluster_death[NUM_CLUSTERS]; // 簇头死亡或成员全部死亡的时隙
+    double next_event[NUM_CLUSTERS][NUM_DRONES_PER_CLUSTER]; // 抽样得到的、第一次不安全的交换距现在的时隙数
+} Lifetime;
+Lifetime lifetime;
+
+// 按固定顺序遍历组内参与外推的统计量：apply为false时读出到v，为true时把v四舍五入后加到统计量上
+void lifetime_visit(Cluster clusters[], LifetimeGroup* g, double* v, bool apply) {
+    int n = 0;
+#define TALLY(field)                        \
+    do {                                    \
+        if (apply) (field) += lround(v[n]); \
+        else v[n] = (field);                \
+        n++;                                \
+    } while (0)
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        int32_t* fields = (int32_t*)&counters[c];
+        for (int i = 0; i < COUNTER_FIELDS; ++i) TALLY(fields[i]);
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            ClassStats* stats = &class_stats[c][k];
+            TALLY(stats->arrived);
+            TALLY(stats->rejected);
+            TALLY(stats->preempted);
+            TALLY(stats->sent);
+            TALLY(stats->delay_slot);
+        }
+        for (int d = 0; d < NUM_DRONES_PER_CLUSTER; ++d) {
+            Node* node = &clusters[c].drones[d];
+            if (d >= clusters[c].node_num) {
+                if (!apply) memset(&v[n], 0, 4 * sizeof(double));
+                n += 4;
+                continue;
+            }
+            // 能量由lifetime_jump按泊松抽样单独外推
+            if (!apply) v[n] = node->energy;
+            n++;
+            TALLY(node->total_delay_slot);
+            TALLY(node->total_sent_packet);
+            TALLY(node->total_throught_put);
+        }
+        TALLY(relay[c].dropped);
+    }
+    if (g->count == NUM_CLUSTERS && relay_enabled) {
+        DelayHistogram* hists[2] = {&relay_main.hop_delay, &relay_main.e2e_delay};
+        for (int h = 0; h < 2; ++h) {
+            TALLY(hists[h]->count);
+            TALLY(hists[h]->sum);
+            for (int b = 0; b < HIST_BINS; ++b) TALLY(hists[h]->bins[b]);
+        }
+        TALLY(relay_main.sink_delivered);
+    }
+#undef TALLY
+}
+
+// 二项分布随机数（n大时用正态近似）
+long binomial(long n, double p) {
+    if (n <= 0 || p <= 0) return 0;
+    if (p >= 1) return n;
+    if (n > 64) {
+        double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+        long k = lround(n * p + sqrt(n * p * (1 - p)) * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2));
+        return k < 0 ? 0 : k > n ? n : k;
+    }
+    long k = 0;
+    for (long i = 0; i < n; ++i) k += (double)rand() / RAND_MAX < p;
+    return k;
+}
+
+// 簇是否还能收发：簇头活着且至少有一个成员活着
+bool cluster_alive(Cluster* cluster) {
+    bool head = false, member = false;
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if (!judge_energy(node)) continue;
+        if (node->is_head) head = true;
+        else member = true;
+    }
+    return head && member;
+}
+
+void lifetime_group_init(Cluster clusters[], LifetimeGroup* g, int first, int count) {
+    memset(g, 0, sizeof(*g));
+    g->first = first;
+    g->count = count;
+    g->tally_len = count * CLUSTER_TALLY_LEN + (count == NUM_CLUSTERS && relay_enabled ? RELAY_TALLY_LEN : 0);
+    g->mark = malloc(g->tally_len * sizeof(double));
+    g->now = malloc(g->tally_len * sizeof(double));
+    g->older = calloc(g->tally_len, sizeof(double));
+    g->newer = calloc(g->tally_len, sizeof(double));
+    lifetime_visit(clusters, g, g->mark, false);
+    for (int c = first; c < first + count; ++c) {
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            bool alive = judge_energy(&clusters[c].drones[d]);
+            lifetime.death_slot[c][d] = alive ? -1 : 0;
+            g->alive += alive;
+        }
+        bool live = cluster_alive(&clusters[c]);
+        lifetime.cluster_death[c] = live ? -1 : 0;
+        g->live_clusters += live;
+    }
+}
+
+void lifetime_group_free(LifetimeGroup* g) {
+    free(g->mark);
+    free(g->now);
+    free(g->older);
+    free(g->newer);
+}
+
+// 推进组内一个时隙并记录死亡时隙
+void lifetime_step(Cluster clusters[], LifetimeGroup* g) {
+    if (g->count == NUM_CLUSTERS) {
+        simulate_slot(clusters, g->clock);
+    } else {
+        Cluster* cluster = &clusters[g->first];
+        if (g->clock % want_period == 0) cluster_want_to_send(cluster, g->clock);
+        update_cluster(cluster, g->clock);
+    }
+    g->clock++;
+    g->detail_slots++;
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        bool died = false;
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            if (lifetime.death_slot[c][d] < 0 && !judge_energy(&clusters[c].drones[d])) {
+                lifetime.death_slot[c][d] = g->clock;
+                g->alive--;
+                died = true;
+            }
+        }
+        if (died && lifetime.cluster_death[c] < 0 && !cluster_alive(&clusters[c])) {
+            lifetime.cluster_death[c] = g->clock;
+            g->live_clusters--;
+        }
+    }
+}
+
+// 簇内空闲：信道空闲且没有存活的无人机有包（死亡无人机的队列还会收包，但永远不竞争）。此时没有能耗，逐时隙模拟只会累加空闲时隙、递减残留的退避，
+// 直到有包到达；到达抽样用的是簇自己的随机数，可以只重放抽样，把空闲时隙整段快进。
+// 快进与逐时隙模拟逐位一致：遇到有包到达的时隙就恢复随机数状态，让lifetime_step从这个时隙接着模拟。
+// 最多快进limit个时隙，返回快进的时隙数
+int lifetime_idle_skip(Cluster* cluster, LifetimeGroup* g, int limit) {
+    if (cluster->channel.state != CHANNEL_IDLE) return 0;
+    for (int d = 0; d < cluster->node_num; ++d) {
+        if (cluster->drones[d].queue_len > 0 && judge_energy(&cluster->drones[d])) return 0;
+    }
+
+    int n = 0;
+    for (; n < limit; ++n) {
+        if ((g->clock + n) % want_period != 0) continue;
+        uint64_t rng = cluster->rng;
+        bool arrival = false;
+        for (int d = 0; d < cluster->node_num && !arrival; ++d) arrival = cluster_random(cluster) < want_prob;
+        if (arrival) {
+            cluster->rng = rng;
+            break;
+        }
+    }
+    if (n == 0) return 0;
+
+    int last = g->clock + n - 1;
+    counters[cluster->id].idle_slot += n;
+    cluster->channel.state_update_slot = last;
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        node->able_send = false;
+        node->back_off_slot = node->back_off_slot > n ? node->back_off_slot - n : 0;
+        if (node->is_dead) node->dead_slot = last;
+    }
+    g->clock += n;
+    return n;
+}
+
+// 簇内某角色（簇头或成员）在一段工况中的交换次数，nodes为该角色存活的无人机数
+double role_events(Cluster* cluster, LifetimeGroup* g, const double* tally, int is_head, int* nodes) {
+    double drain = 0;
+    *nodes = 0;
+    tally += (cluster->id - g->first) * CLUSTER_TALLY_LEN;
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if (node->is_head != is_head || !judge_energy(node)) continue;
+        drain -= tally[TALLY_ENERGY(d)];
+        (*nodes)++;
+    }
+    return drain / (is_head ? HEAD_EXCHANGE_ENERGY : MEMBER_EXCHANGE_ENERGY);
+}
+
+// 簇在整个工况（两段合计）中某个计数器的增量
+double regime_counter(LifetimeGroup* g, int c, size_t offset) {
+    int i = (c - g->first) * CLUSTER_TALLY_LEN + offset / sizeof(int32_t);
+    return g->older[i] + g->newer[i];
+}
+
+// 只有冲突的活锁：工况里一直有冲突却没有一次RTS成功。冲突状态下send_rts不耗能，
+// 竞争节点集合不变时这是能耗为0的稳定工况，可以跳过去
+bool clash_livelock(LifetimeGroup* g, int c) {
+    return regime_counter(g, c, offsetof(ClusterCounters, clash_slot)) > 0 &&
+           regime_counter(g, c, offsetof(ClusterCounters, rts)) == 0;
+}
+
+// 两段工况中每个角色的交换速率是否一致；enough返回观测到的交换次数是否足够
+bool lifetime_consistent(Cluster clusters[], LifetimeGroup* g, bool* enough) {
+    *enough = true;
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        bool livelock = clash_livelock(g, c);
+        for (int role = 0; role < 2; ++role) {
+            int nodes;
+            double a = role_events(&clusters[c], g, g->older, role, &nodes);
+            double b = role_events(&clusters[c], g, g->newer, role, &nodes);
+            if (nodes == 0) continue;
+            // 簇还能收发、又有包到达时，没观测到交换只说明速率太低、窗口太短，不能当作速率为0；活锁除外
+            if (a + b == 0 && (want_prob <= 0 || !cluster_alive(&clusters[c]) || livelock)) continue;
+            if (a + b < LIFETIME_MIN_EVENTS) *enough = false;
+            // 泊松计数的速率差检验，计数为0时按1估计方差
+            double ta = g->older_slots, tb = g->newer_slots;
+            double sd = sqrt(fmax(a, 1) / (ta * ta) + fmax(b, 1) / (tb * tb));
+            if (fabs(a / ta - b / tb) > LIFETIME_Z * sd) return false;
+        }
+    }
+    return true;
+}
+
+// 簇头有包且活着：簇头的包永远发不出去（只有成员发PACKET），它一旦有包就一直参与竞争，
+// 获胜时沿用旧的nch_id走完整个交换周期，由那个成员付出DATA和PACKET的能耗
+bool head_busy(Cluster* cluster) {
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if (node->is_head) return node->queue_len > 0 && judge_energy(node);
+    }
+    return false;
+}
+
+// 竞争节点集合的特征：存活的无人机数、有包的簇头，以及这些簇里替簇头付出能耗的nch_id
+uint64_t lifetime_population(Cluster clusters[], LifetimeGroup* g) {
+    uint64_t h = hash_mix(0xcbf29ce484222325ULL, g->alive);
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        if (head_busy(&clusters[c])) h = hash_mix(hash_mix(h, c), clusters[c].channel.nch_id);
+    }
+    return h;
+}
+
+// 丢弃当前工况
+void lifetime_reset(LifetimeGroup* g) {
+    memset(g->older, 0, g->tally_len * sizeof(double));
+    memset(g->newer, 0, g->tally_len * sizeof(double));
+    g->older_slots = g->newer_slots = 0;
+}
+
+// 窗口结束：把窗口内的增量并入工况，返回能耗速率是否已稳定到可以跳跃
+bool lifetime_window_end(Cluster clusters[], LifetimeGroup* g, uint64_t population_at_mark) {
+    lifetime_visit(clusters, g, g->now, false);
+    if (lifetime_population(clusters, g) != population_at_mark) {
+        // 竞争节点集合变了：丢弃旧工况，这个窗口本身也跨越了变化，不计入
+        lifetime_reset(g);
+        memcpy(g->mark, g->now, g->tally_len * sizeof(double));
+        return false;
+    }
+
+    double* target = g->older_slots == 0 ? g->older : g->newer;
+    for (int i = 0; i < g->tally_len; ++i) target[i] += g->now[i] - g->mark[i];
+    if (target == g->older) g->older_slots += lifetime.window;
+    else g->newer_slots += lifetime.window;
+    memcpy(g->mark, g->now, g->tally_len * sizeof(double));
+
+    bool enough = false;
+    bool consistent = g->newer_slots > 0 && lifetime_consistent(clusters, g, &enough);
+    if (g->newer_slots >= g->older_slots) {
+        if (consistent) {
+            // 两段一致：合并成较早一段，工况继续变长
+            for (int i = 0; i < g->tally_len; ++i) g->older[i] += g->newer[i];
+            g->older_slots += g->newer_slots;
+        } else {
+            // 不一致：丢弃较早一段，较新一段成为较早一段
+            double* older = g->older;
+            g->older = g->newer;
+            g->older_slots = g->newer_slots;
+            g->newer = older;
+        }
+        g->newer_slots = 0;
+        memset(g->newer, 0, g->tally_len * sizeof(double));
+    }
+    return consistent && enough && g->older_slots + g->newer_slots >= LIFETIME_MIN_WINDOWS * lifetime.window;
+}
+
+// 簇内成员的投递率：工况中成员成功发出的包数 / 按want_prob期望到达的包数（不超过1）
+double delivery_ratio(Cluster* cluster, LifetimeGroup* g) {
+    const double* older = g->older + (cluster->id - g->first) * CLUSTER_TALLY_LEN;
+    const double* newer = g->newer + (cluster->id - g->first) * CLUSTER_TALLY_LEN;
+    double sent = 0;
+    int members = 0;
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if (node->is_head || !judge_energy(node)) continue;
+        sent += older[TALLY_SENT(d)] + newer[TALLY_SENT(d)];
+        members++;
+    }
+    double offered = members * (g->older_slots + g->newer_slots) * want_prob / want_period;
+    return offered > 0 ? fmin(sent / offered, 1.0) : 0;
+}
+
+// 第d架无人机在工况中的每时隙能耗 = 自己的包按簇的投递率发出的能耗 + 其余能耗
+// （簇头的全部能耗，以及簇头获胜时沿用旧nch_id的成员多耗的DATA和PACKET）。
+// 单架无人机一生只有十几次交换，自己的投递次数噪声太大，所以按已知的到达率和全簇合并的投递率估计；
+// 其余能耗只出现在个别无人机上，按它自己的观测估计
+double drone_drain(Cluster* cluster, LifetimeGroup* g, int d, double ratio) {
+    Node* node = &cluster->drones[d];
+    long slots = g->older_slots + g->newer_slots;
+    if (slots == 0) return 0;
+    const double* older = g->older + (cluster->id - g->first) * CLUSTER_TALLY_LEN;
+    const double* newer = g->newer + (cluster->id - g->first) * CLUSTER_TALLY_LEN;
+    double drain = -(older[TALLY_ENERGY(d)] + newer[TALLY_ENERGY(d)]);
+    if (node->is_head) return drain / slots;
+    double sent = older[TALLY_SENT(d)] + newer[TALLY_SENT(d)];
+    double other = fmax(drain - sent * MEMBER_EXCHANGE_ENERGY, 0) / slots;
+    return ratio * want_prob / want_period * MEMBER_EXCHANGE_ENERGY + other;
+}
+
+// 速率为rate的泊松过程中第k个事件发生的时间（k大时用正态近似）
+double event_time(int k, double rate) {
+    if (k > 30) {
+        double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+        double t = (k + sqrt(k) * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2)) / rate;
+        return t > 0 ? t : 0;
+    }
+    double t = 0;
+    for (int i = 0; i < k; ++i) t -= log((rand() + 1.0) / (RAND_MAX + 2.0)) / rate;
+    return t;
+}
+
+// 每架无人机还能安全做的交换次数：做完后能量仍比死亡阈值高LIFETIME_GUARD
+long safe_exchanges(Node* node) {
+    int unit = node->is_head ? HEAD_EXCHANGE_ENERGY : MEMBER_EXCHANGE_ENERGY;
+    long safe = (node->energy - 2 - LIFETIME_GUARD) / unit;
+    return safe > 0 ? safe : 0;
+}
+
+// 跳跃终点上发生的事件
+typedef enum {
+    JUMP_NONE,     // 达到跳跃长度上限
+    JUMP_EXCHANGE, // 某架无人机做了第safe+1次交换，之后的交换可能致死
+    JUMP_ARRIVAL,  // 空闲的簇头来了第一个包
+    JUMP_NCH       // 有包的簇头所在簇里有成员RTS成功，nch_id改变
+} JumpEvent;
+
+// 尝试跳跃：抽样出最早的一个会改变工况或接近死亡阈值的事件，直接跳到它发生的时隙并施加它。
+// 每架无人机的交换是泊松过程，第safe+1次交换发生在next_event时刻，前safe次交换在
+// [0, next_event]上均匀分布，所以跳跃中的交换次数服从Binomial(safe, jump/next_event)。
+// 事件就在下一个窗口内时不跳（抽样直接丢弃，逐时隙模拟不受影响），返回是否跳了
+bool lifetime_try_jump(Cluster clusters[], LifetimeGroup* g, int remaining) {
+    static double rate[NUM_CLUSTERS][NUM_DRONES_PER_CLUSTER];
+    double jump = (double)LIFETIME_MAX_WINDOWS * lifetime.window;
+    if (remaining < jump) jump = remaining;
+    JumpEvent event = JUMP_NONE;
+    int event_cluster = -1, event_drone = -1;
+    long slots = g->older_slots + g->newer_slots;
+
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        Cluster* cluster = &clusters[c];
+        double ratio = delivery_ratio(cluster, g);
+        if (head_busy(cluster)) {
+            double rts = regime_counter(g, c, offsetof(ClusterCounters, rts)) / slots;
+            double t = rts > 0 ? ceil(event_time(1, rts)) : INFINITY;
+            if (t < jump) {
+                jump = t;
+                event = JUMP_NCH;
+                event_cluster = c;
+            }
+        }
+        for (int d = 0; d < cluster->node_num; ++d) {
+            Node* node = &cluster->drones[d];
+            rate[c][d] = drone_drain(cluster, g, d, ratio);
+            lifetime.next_event[c][d] = INFINITY;
+            if (!judge_energy(node)) continue;
+            if (rate[c][d] > 0) {
+                int unit = node->is_head ? HEAD_EXCHANGE_ENERGY : MEMBER_EXCHANGE_ENERGY;
+                double t = ceil(event_time(safe_exchanges(node) + 1, rate[c][d] / unit));
+                lifetime.next_event[c][d] = t;
+                if (t < jump) {
+                    jump = t;
+                    event = JUMP_EXCHANGE;
+                    event_cluster = c;
+                    event_drone = d;
+                }
+            }
+            // 到达只发生在want_period的整数倍时隙上，按每次机会一次的伯努利试验抽样
+            if (node->is_head && node->queue_len == 0 && want_prob > 0) {
+                double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+                double trials = want_prob < 1 ? ceil(log(u) / log(1 - want_prob)) : 1;
+                double t = (g->clock + want_period - 1) / want_period * want_period - g->clock + (trials - 1) * want_period;
+                if (t < jump) {
+                    jump = t;
+                    event = JUMP_ARRIVAL;
+                    event_cluster = c;
+                    event_drone = d;
+                }
+            }
+        }
+    }
+    if (jump < lifetime.window) return false;
+    int n = (int)jump;
+
+    // 统计量按工况速率外推
+    for (int i = 0; i < g->tally_len; ++i) g->now[i] = (g->older[i] + g->newer[i]) * n / slots;
+    lifetime_visit(clusters, g, g->now, true);
+
+    for (int c = g->first; c < g->first + g->count; ++c) {
+        Cluster* cluster = &clusters[c];
+        cluster->channel.state_update_slot += n;
+        for (int d = 0; d < cluster->node_num; ++d) {
+            Node* node = &cluster->drones[d];
+            node->start_slot += n;
+            for (int q = 0; q < node->queue_len; ++q) node->queue[q].arrival_slot += n;
+            if (!judge_energy(node) || isinf(lifetime.next_event[c][d])) continue;
+            int unit = node->is_head ? HEAD_EXCHANGE_ENERGY : MEMBER_EXCHANGE_ENERGY;
+            long safe = safe_exchanges(node);
+            long exchanges = event == JUMP_EXCHANGE && c == event_cluster && d == event_drone
+                                 ? safe + 1
+                                 : binomial(safe, n / lifetime.next_event[c][d]);
+            node->energy -= exchanges * unit;
+        }
+        RelayState* r = &relay[c];
+        for (int q = 0; q < r->queue_len; ++q) {
+            RelayPacket* p = &r->queue[(r->queue_first + q) % RELAY_QUEUE_LEN];
+            p->origin_slot += n;
+            p->hop_slot += n;
+        }
+    }
+    if (g->count == NUM_CLUSTERS) {
+        for (int i = 0; i < relay_main.pending_num; ++i) {
+            relay_main.pending[i].packet.origin_slot += n;
+            relay_main.pending[i].packet.hop_slot += n;
+        }
+    }
+    g->clock += n;
+    g->jumps++;
+
+    if (event == JUMP_ARRIVAL) {
+        Cluster* cluster = &clusters[event_cluster];
+        Node* head = &cluster->drones[event_drone];
+        enqueue_packet(cluster, head, draw_class(cluster, head), g->clock);
+    } else if (event == JUMP_NCH) {
+        // 在有包的存活成员中随机选一个作为RTS成功者
+        Cluster* cluster = &clusters[event_cluster];
+        int candidates[NUM_DRONES_PER_CLUSTER], k = 0;
+        for (int d = 0; d < cluster->node_num; ++d) {
+            Node* node = &cluster->drones[d];
+            if (!node->is_head && node->want_to_send && judge_energy(node)) candidates[k++] = d;
+        }
+        if (k > 0) cluster->channel.nch_id = cluster->drones[candidates[rand() % k]].id;
+    }
+    lifetime_visit(clusters, g, g->mark, false);
+    return true;
+}
+
+// 推进一个组直到组内的簇都不能收发或max_slots为止
+void simulate_lifetime_group(Cluster clusters[], LifetimeGroup* g, int max_slots) {
+    uint64_t population_at_mark = lifetime_population(clusters, g);
+    int window_fill = 0;
+    while (g->clock < max_slots && g->live_clusters > 0) {
+        // 不开中继时空闲的簇整段快进（不超过当前窗口），开中继时各簇耦合，逐时隙模拟
+        int skipped = lifetime.coarsen && g->count == 1
+                          ? lifetime_idle_skip(&clusters[g->first], g, fmin(max_slots - g->clock, lifetime.window - window_fill))
+                          : 0;
+        if (skipped == 0) {
+            lifetime_step(clusters, g);
+            skipped = 1;
+        }
+        if (g->count == NUM_CLUSTERS) publish_stats(g->clock, false);
+        window_fill += skipped;
+        if (!lifetime.coarsen || window_fill < lifetime.window) continue;
+
+        window_fill = 0;
+        bool stable = lifetime_window_end(clusters, g, population_at_mark);
+        population_at_mark = lifetime_population(clusters, g);
+        if (!stable || !lifetime_try_jump(clusters, g, max_slots - g->clock)) continue;
+
+        // 跳跃终点上的事件改变了竞争节点集合：工况重新开始
+        uint64_t population = lifetime_population(clusters, g);
+        if (population != population_at_mark) {
+            lifetime_reset(g);
+            population_at_mark = population;
+        }
+    }
+}
+
+int compare_int(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// 模拟到网络死亡或max_slots为止；coarsen为false时全程逐时隙模拟（即simulate_slot）
+LifetimeResult simulate_lifetime(Cluster clusters[], int max_slots, bool coarsen) {
+    LifetimeResult result = {-1, -1, -1, 0, 0, 0, 0, 0};
+    double start = now_ms();
+    int lcm = CYCLE_SLOTS;
+    while (lcm % want_period != 0) lcm += CYCLE_SLOTS;
+    lifetime.coarsen = coarsen;
+    lifetime.window = (LIFETIME_WINDOW + lcm - 1) / lcm * lcm;
+
+    // 中继把各簇耦合在一起，只能整体推进
+    bool joint = !coarsen || relay_enabled;
+    int groups = joint ? 1 : NUM_CLUSTERS;
+    for (int i = 0; i < groups; ++i) {
+        LifetimeGroup g;
+        lifetime_group_init(clusters, &g, joint ? 0 : i, joint ? NUM_CLUSTERS : 1);
+        simulate_lifetime_group(clusters, &g, max_slots);
+        if (g.clock > result.slots) result.slots = g.clock;
+        result.cluster_slots += (long)g.clock * g.count;
+        result.detail_slots += g.detail_slots * g.count;
+        result.jumps += g.jumps;
+        lifetime_group_free(&g);
+        if (!joint) publish_stats(result.slots, false);
+    }
+
+    // 按死亡时隙排序得到寿命指标
+    static int deaths[NUM_CLUSTERS * NUM_DRONES_PER_CLUSTER];
+    int total = 0, dead = 0, network_death = 0;
+    for (int c = 0; c < NUM_CLUSTERS; ++c) {
+        for (int d = 0; d < clusters[c].node_num; ++d) {
+            total++;
+            if (lifetime.death_slot[c][d] >= 0) deaths[dead++] = lifetime.death_slot[c][d];
+        }
+        if (network_death >= 0) {
+            network_death = lifetime.cluster_death[c] < 0 ? -1 : fmax(network_death, lifetime.cluster_death[c]);
+        }
+    }
+    qsort(deaths, dead, sizeof(int), compare_int);
+    if (dead > 0) result.first_death = deaths[0];
+    if (total > 0 && dead >= (total + 1) / 2) result.half_death = deaths[(total + 1) / 2 - 1];
+    result.network_death = network_death;
+
+    result.wall_ms = now_ms() - start;
+    return result;
+}
+
+void print_lifetime_event(const char* label, int slot) {
+    if (slot < 0) printf("%s: not reached\n", label);
+    else printf("%s: slot %d (%.3fs)\n", label, slot, slot * SLOT_TIME / 1e6);
+}
+
+void print_lifetime(LifetimeResult* result) {
+    printf("Lifetime (%s):\n", lifetime.coarsen ? "adaptive coarsening" : "full detail");
+    print_lifetime_event("  first drone death", result->first_death);
+    print_lifetime_event("  half drones dead", result->half_death);
+    print_lifetime_event("  network death", result->network_death);
+    printf("  simulated %d slots, %.1fx fewer cluster-slots in detail, %d jumps, %.1fms\n", result->slots,
+           result->detail_slots ? (double)result->cluster_slots / result->detail_slots : 0, result->jumps, result->wall_ms);
+}
+
+// 对同一拓扑分别做全程逐时隙和自适应粗化模拟，统计寿命的相对误差和加速比
+int validate_lifetime(int runs, int max_slots) {
+    Cluster* clusters = alloc_clusters();
+    bool saved_quiet = quiet_mode;
+    const char* labels[3] = {"first_death", "half_death", "network_death"};
+    double err_sum[3] = {0}, err_sq[3] = {0}, err_max[3] = {0};
+    int err_n[3] = {0};
+    double detail_ms = 0, coarse_ms = 0;
+    long simulated = 0, detailed = 0;
+    quiet_mode = true;
+
+    printf("seed  %-25s %-25s %-25s speedup\n", "first_death detail/hybrid", "half_death detail/hybrid",
+           "network_death detail/hyb.");
+    for (int seed = 1; seed <= runs; ++seed) {
+        srand(seed);
+        initialize_clusters(clusters);
+        reset_statistics();
+        if (relay_enabled) relay_init(clusters);
+        LifetimeResult full = simulate_lifetime(clusters, max_slots, false);
+
+        srand(seed);
+        initialize_clusters(clusters);
+        reset_statistics();
+        if (relay_enabled) relay_init(clusters);
+        LifetimeResult hybrid = simulate_lifetime(clusters, max_slots, true);
+
+        int a[3] = {full.first_death, full.half_death, full.network_death};
+        int b[3] = {hybrid.first_death, hybrid.half_death, hybrid.network_death};
+        printf("%4d ", seed);
+        for (int m = 0; m < 3; ++m) {
+            printf(" %12d/%-12d", a[m], b[m]);
+            if (a[m] <= 0 || b[m] <= 0) continue;
+            double err = (double)(b[m] - a[m]) / a[m];
+            err_sum[m] += err;
+            err_sq[m] += err * err;
+            if (fabs(err) > err_max[m]) err_max[m] = fabs(err);
+            err_n[m]++;
+        }
+        printf(" %6.1fx\n", hybrid.wall_ms > 0 ? full.wall_ms / hybrid.wall_ms : 0);
+        detail_ms += full.wall_ms;
+        coarse_ms += hybrid.wall_ms;
+        simulated += hybrid.cluster_slots;
+        detailed += hybrid.detail_slots;
+    }
+
+    printf("--------------------------------------\n");
+    printf("Relative error of adaptive coarsening against full detail over %d runs (mean ±95%% CI, max):\n", runs);
+    for (int m = 0; m < 3; ++m) {
+        if (err_n[m] == 0) {
+            printf("  %-14s not reached\n", labels[m]);
+            continue;
+        }
+        double mean = err_sum[m] / err_n[m];
+        double hw = 0;
+        if (err_n[m] > 1) {
+            double var = (err_sq[m] - err_n[m] * mean * mean) / (err_n[m] - 1);
+            hw = t_quantile(err_n[m] - 1) * sqrt(fmax(var, 0) / err_n[m]);
+        }
+        printf("  %-14s %+.2f%% ±%.2f%%, max %.2f%% (%d runs)\n", labels[m], 100 * mean, 100 * hw, 100 * err_max[m], err_n[m]);
+    }
+    printf("Speedup: %.1fx wall time (%.0fms vs %.0fms), %.1fx fewer cluster-slots simulated in detail\n",
+           coarse_ms > 0 ? detail_ms / coarse_ms : 0, detail_ms, coarse_ms, detailed ? (double)simulated / detailed : 0);
+    quiet_mode = saved_quiet;
+    free(clusters);
+    return 0;
+}
+
+// 分析模型的输入：退避窗口表、能量等级阈值、簇规模和负载都是参数，sweep逐点修改，不必重新编译
+typedef struct {
+    int cw[NUM_CLASSES][NUM_TIERS]; // 基础退避窗口（BACKOFF_UNIT个时隙），按[类别][能量等级]，默认取cw_table
+    int max_stage[NUM_CLASSES];     // 各类别窗口最多翻倍的次数，默认取cw_max_stage
+    double r1, r2;                  // 能量等级阈值（占MAX_ENERGY的比例），默认取R1/R2
+    int members;                    // 簇内存活的成员数（不含簇头）
+    int energy;                     // 成员的剩余能量，按r1/r2决定能量等级；簇头能量大，总在最高等级
+    int period;                     // 业务负载：每period个时隙每个节点以prob的概率来一个包
+    double prob;
+    double mix[NUM_CLASSES];        // 成员的业务构成
+    int head_class;                 // 簇头队首包的类别：簇头从不出队，更高优先级的包到达时会顶替队首，
+                                    // 稳态下是它的业务构成里优先级最高的类别
+} ModelParams;
+
+// 分析模型的预测结果
+typedef struct {
+    int stations;          // 参与竞争的节点数（成员加簇头）
+    double busy;           // 成员队列非空的概率
+    double tau;            // 成员在每个格点发送的平均概率
+    double head_backoff;   // 簇头处于退避中的格点比例
+    double p_collision;    // 条件碰撞概率（按发送尝试加权，含簇头）
+    double offered;        // 成员的负载（b/us）
+    double throughput;     // 投递的吞吐量（b/us）
+    double access_delay;   // 成员的包成为队首后到发送成功的平均时间（us）
+    double reported_delay; // 从到达算起、经过MIN_DELAY_SLOT过滤后的平均时延（us），与print_final_statistics口径一致
+    int iterations;        // 不动点迭代次数
+} ModelEstimate;
+
+// 业务构成里优先级最高的类别
+int top_class(const double mix[]) {
+    for (int k = 0; k < NUM_CLASSES; ++k) {
+        if (mix[k] > 0) return k;
+    }
+    return NUM_CLASSES - 1;
+}
+
+// 按编译期的宏和当前的业务参数填默认值，与模拟器的缺省配置一致
+void model_default_params(ModelParams* p) {
+    memcpy(p->cw, cw_table, sizeof(p->cw));
+    memcpy(p->max_stage, cw_max_stage, sizeof(p->max_stage));
+    p->r1 = R1;
+    p->r2 = R2;
+    p->members = NUM_DRONES_PER_CLUSTER - 1;
+    p->energy = MAX_ENERGY;
+    p->period = want_period;
+    p->prob = want_prob;
+    memcpy(p->mix, default_mix, sizeof(p->mix));
+    p->head_class = top_class(default_mix);
+}
+
+// 按CW_P1..CW_P3的取值算窗口表，规则与cw_table相同
+void model_set_windows(ModelParams* p, const int cw_p[NUM_CLASSES]) {
+    for (int k = 0; k < NUM_CLASSES; ++k) {
+        for (int t = 0; t < NUM_TIERS; ++t) p->cw[k][t] = CW_FLOOR(cw_p[k] >> (t + 1));
+    }
+}
+
+// 从簇的当前状态取参数：成员数、平均能量和业务构成，簇头的队首类别由它的业务构成决定
+void model_params_from_cluster(Cluster* cluster, ModelParams* p) {
+    model_default_params(p);
+    long energy = 0;
+    int members = 0;
+    memset(p->mix, 0, sizeof(p->mix));
+    for (int d = 0; d < cluster->node_num; ++d) {
+        Node* node = &cluster->drones[d];
+        if (!judge_energy(node)) continue;
+        if (node->is_head) {
+            p->head_class = top_class(node->class_mix);
+            continue;
+        }
+        members++;
+        energy += node->energy;
+        for (int k = 0; k < NUM_CLASSES; ++k) p->mix[k] += node->class_mix[k];
+    }
+    p->members = members;
+    p->energy = members ? (int)(energy / members) : MAX_ENERGY;
+    for (int k = 0; k < NUM_CLASSES; ++k) p->mix[k] = members ? p->mix[k] / members : default_mix[k];
+}
+
+// 与energy_tier相同，只是阈值取参数
+int model_tier(const ModelParams* p, int energy) {
+    if (energy >= 0 && energy < p->r1 * MAX_ENERGY) return 2;
+    if (energy >= 0 && energy < p->r2 * MAX_ENERGY) return 1;
+    return 0;
+}
+
+// 两个独立的退避 B ~ U[1,a]、H ~ U[1,b]（格点）：P(H <= B)、P(H == B)和E[min(B,H)]
+double backoff_not_before(int a, int b) {
+    double sum = 0;
+    for (int x = 1; x <= a; ++x) sum += x < b ? x : b;
+    return sum / ((double)a * b);
+}
+
+// 成员和簇头在同一次冲突后分别退避B ~ U[1,a]、H ~ U[1,b]，成员到期的那个格点簇头也在发送的概率。
+// H > B时簇头还在退避；H == B时同时到期；H < B时簇头先到期、之后每个格点都发送，
+// 直到以hit的概率被别的成员撞上，再退避backoff（稳态时簇头在退避中的比例）那么久
+double head_sends_at(int a, int b, double hit, double backoff) {
+    double q = 1 - hit, sum = 0;
+    for (int x = 1; x <= a; ++x) {
+        int m = x < b ? x : b; // H <= x的取值个数
+        // H = x - d (d = x-m..x-1)时已发送了d个格点：仍在发送的概率为1 - backoff·(1 - q^d)
+        double recent = hit > 0 ? pow(q, x - m) * (1 - pow(q, m)) / hit : m; // sum_{x-m<=d<x} q^d
+        sum += m * (1 - backoff) + backoff * recent;
+    }
+    return sum / ((double)a * b);
+}
+
+double backoff_tie(int a, int b) {
+    return (double)(a < b ? a : b) / ((double)a * b);
+}
+
+double backoff_min(int a, int b) {
+    double sum = 0;
+    for (int x = 1; x <= a && x <= b; ++x) sum += (double)(a - x + 1) / a * (b - x + 1) / b;
+    return sum;
+}
+
+// 一个队首包从开始竞争到发送成功的过程（退避阶数链）
+typedef struct {
+    double grids;     // 退避占用的格点数（不含最后一次交换）
+    double attempts;  // 发送尝试次数
+    double collided;  // 冲突的尝试次数
+    double with_head; // 与簇头在同一格点发送的尝试次数，每次都让簇头冲突
+    double by_head;   // 由簇头获胜的交换代为投递的概率
+} AccessChain;
+
+// 沿退避阶数链计算一个队首包的接入过程，a是尝试时簇头也在发送的概率。簇头从不出队、退避上限一直是最高阶，
+// 不在退避中就每个格点都竞争：第一次尝试时a是簇头不在退避中的概率；上一次冲突有簇头参与时双方同时抽退避，
+// a见head_sends_at；没有簇头参与时仍按时间比例。
+// stale表示该成员是nch_id：簇头先到期并单独获胜时沿用旧的nch_id，那次交换替它投递，退避按min(B,H)结束。
+// others是其他成员都不发送的概率，head_backoff是簇头处于退避中的格点比例，head_hit是簇头每次发送被撞上的概率
+AccessChain access_chain(int window, int max_stage, int head_window, double head_backoff, double head_hit, double others,
+                         bool stale) {
+    AccessChain c = {0};
+    double reach = 1, a = 1 - head_backoff;
+    for (int j = 0;; ++j) {
+        int w = window << (j + 1 < max_stage ? j + 1 : max_stage); // 冲突后进入j+1阶的窗口
+        double fail = 1 - (1 - a) * others;
+        double involved = fail > 0 ? a / fail : 0; // 冲突中有簇头参与的概率
+        double before = backoff_not_before(w, head_window), tie = backoff_tie(w, head_window);
+        double head_first = 0, wait = (w + 1) / 2.0;
+        double a_next = involved * head_sends_at(w, head_window, head_hit, head_backoff) + (1 - involved) * (1 - head_backoff);
+        if (stale) {
+            head_first = involved * (before - tie) * others;
+            wait = involved * backoff_min(w, head_window) + (1 - involved) * wait;
+            a_next = (involved * (tie + (before - tie) * (1 - others)) + (1 - involved) * (1 - head_backoff)) / (1 - head_first);
+        }
+        double next = fail * (1 - head_first);
+        // 窗口不再翻倍、a也稳定后各轮同分布，按几何级数一次算完剩下的轮次
+        bool last = j + 1 >= max_stage && (fabs(a_next - a) < 1e-9 || j > 1000);
+        double rounds = last ? reach / fmax(1 - next, 1e-12) : reach;
+        c.attempts += rounds;
+        c.with_head += rounds * a;
+        c.collided += rounds * fail;
+        c.grids += rounds * fail * wait;
+        c.by_head += rounds * fail * head_first;
+        if (last) break;
+        reach *= next;
+        a = a_next;
+    }
+    return c;
+}
+
+// 退避和交换都是BACKOFF_UNIT的整数倍，节点的相位（时隙模BACKOFF_UNIT）只由包的到达时刻决定：
+// 信道空闲时新到的包按到达时刻抽一个相位（共phases种），在交换期间到期或到达的节点在交换结束时发送，
+// 并入那次交换的相位。reseed和merge分别是每个成员每个格点换成新相位和并入别人相位的速率，
+// 按两者的平衡（Moran模型）求两个成员处于同一相位的稳态概率
+double phase_share(int period, int n, double reseed, double merge) {
+    int a = period, b = BACKOFF_UNIT;
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    int phases = BACKOFF_UNIT / a;
+    if (phases <= 1 || n <= 1 || reseed <= 0) return 1;
+    if (merge <= 0) return 1.0 / phases;
+    double x = reseed * (n - 1) / merge;
+    return (1 + x / phases) / (1 + x);
+}
+
+// 稳态时队首包在这个格点数附近，迭代到各量的变化小于MODEL_TOLERANCE为止
+#define MODEL_TOLERANCE 1e-10
+#define MODEL_MAX_ITERATIONS 2000
+
+// 分析模型的不动点。各成员对称：忙（队列非空）的概率为busy，忙时按队首类别的退避阶数链竞争。
+// 簇头只要有包就一直竞争，它被成员的尝试撞上后按最高阶窗口退避，head_backoff是它在退避中的格点比例。
+// 退避时长和成功交换都是BACKOFF_UNIT的整数倍，尝试按相位分组，组内锁相在格点上（见phase_share）。
+// 队列按M/M/1/K近似：服务时间取队首类别的平均接入时间，过载时按优先级从高到低填满服务能力
+// （低优先级的包被挤掉或拒绝），所以队首类别的分布从业务构成过渡到只有最高优先级的类别。
+// 过载时队列几乎不空、不再产生新相位，模型给出的是所有成员并入同一相位时的容量，是实际吞吐量的下限
+ModelEstimate estimate_model(const ModelParams* p) {
+    ModelEstimate est = {0};
+    int n = p->members;
+    est.stations = n + 1;
+    if (n <= 0 || p->prob <= 0 || p->period <= 0) return est;
+
+    double lambda = p->prob / p->period * BACKOFF_UNIT; // 每个成员每个格点的到达数
+    int tier = model_tier(p, p->energy);
+    int head_stage = p->max_stage[p->head_class] < CW_MAX_STAGE ? p->max_stage[p->head_class] : CW_MAX_STAGE;
+    int head_window = p->cw[p->head_class][0] << head_stage;
+    double head_wait = (head_window + 1) / 2.0;
+
+    double tau = 0, head_backoff = 0, busy = 0, own_rate = 0, lam_eff = 0, queue = 0, collide_head = 0;
+    double service[NUM_CLASSES], weight[NUM_CLASSES];
+    AccessChain chain[NUM_CLASSES];
+    for (est.iterations = 1; est.iterations <= MODEL_MAX_ITERATIONS; ++est.iterations) {
+        // 交换结束时发送的成员和所有到期的成员竞争，信道空闲时只和同相位的成员竞争
+        double exchanges = fmin(1, (1 - head_backoff) * (1 - collide_head) + n * own_rate);
+        double share = phase_share(p->period, n, lambda * (1 - busy) * (1 - exchanges), (tau + lambda * (1 - busy)) * exchanges);
+        double others = exchanges * pow(1 - tau, n - 1) + (1 - exchanges) * pow(1 - tau * share, n - 1);
+        double rival = (n - 1) * own_rate; // 其他成员RTS成功的速率，成功后nch_id就换了人
+        double stale0 = busy + (1 - busy) * (lambda + rival > 0 ? lambda / (lambda + rival) : 0);
+
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            int stage = p->max_stage[k] < CW_MAX_STAGE ? p->max_stage[k] : CW_MAX_STAGE;
+            AccessChain plain = access_chain(p->cw[k][tier], stage, head_window, head_backoff, collide_head, others, false);
+            AccessChain st = access_chain(p->cw[k][tier], stage, head_window, head_backoff, collide_head, others, true);
+            // 成员刚出队时nch_id还是它；队列空着等包时，期间没有别的成员RTS成功才仍是它；等待中也可能被换掉
+            double stale = stale0 / (1 + rival * (st.grids + 1));
+            chain[k].grids = stale * st.grids + (1 - stale) * plain.grids;
+            chain[k].attempts = stale * st.attempts + (1 - stale) * plain.attempts;
+            chain[k].collided = stale * st.collided + (1 - stale) * plain.collided;
+            chain[k].with_head = stale * st.with_head + (1 - stale) * plain.with_head;
+            chain[k].by_head = stale * st.by_head;
+            service[k] = chain[k].grids + 1;
+        }
+
+        // 按优先级填满服务能力
+        double left = 1, served[NUM_CLASSES], served_sum = 0, busy_sum = 0;
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            served[k] = fmin(lambda * p->mix[k], left / service[k]);
+            left -= served[k] * service[k];
+            served_sum += served[k];
+            busy_sum += served[k] * service[k];
+        }
+        double mean_service = served_sum > 0 ? busy_sum / served_sum : service[0];
+        for (int k = 0; k < NUM_CLASSES; ++k) weight[k] = busy_sum > 0 ? served[k] * service[k] / busy_sum : (k == 0);
+
+        // M/M/1/K
+        double rho = lambda * mean_service, pl = 1, norm = 0, mean_len = 0;
+        for (int l = 0; l <= QUEUE_LEN; ++l) {
+            norm += pl;
+            mean_len += l * pl;
+            if (l < QUEUE_LEN) pl *= rho;
+        }
+        double busy_next = 1 - 1 / norm;
+        lam_eff = lambda * (1 - pl / norm);
+        queue = mean_len / norm;
+
+        double tau_busy = 0, with_head = 0, by_head = 0;
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            tau_busy += weight[k] * chain[k].attempts / service[k];
+            with_head += weight[k] * chain[k].with_head / service[k];
+            by_head += weight[k] * chain[k].by_head / service[k];
+        }
+        double tau_next = busy_next * tau_busy;
+        double own_next = lam_eff * (1 - by_head * mean_service);
+        // 簇头尝试时每个成员同时发送的概率，由此得到簇头的冲突概率和退避比例
+        double cond = head_backoff < 1 ? fmin(1, busy_next * with_head / (1 - head_backoff)) : 1;
+        collide_head = 1 - pow(1 - cond, n);
+        double backoff_next = collide_head * head_wait / (1 + collide_head * head_wait);
+
+        double delta = fmax(fmax(fabs(tau_next - tau), fabs(backoff_next - head_backoff)), fmax(fabs(busy_next - busy), fabs(own_next - own_rate)));
+        tau = 0.5 * tau + 0.5 * tau_next;
+        head_backoff = 0.5 * head_backoff + 0.5 * backoff_next;
+        busy = 0.5 * busy + 0.5 * busy_next;
+        own_rate = 0.5 * own_rate + 0.5 * own_next;
+        if (delta < MODEL_TOLERANCE) break;
+    }
+
+    double per_grid = 0, collided = 0; // 忙时每个格点完成的包数和冲突的尝试数
+    for (int k = 0; k < NUM_CLASSES; ++k) {
+        per_grid += weight[k] / service[k];
+        collided += weight[k] * chain[k].collided / service[k];
+    }
+    double mean_service = per_grid > 0 ? 1 / per_grid : service[0];
+
+    double head_attempts = 1 - head_backoff, member_attempts = n * tau;
+    est.busy = busy;
+    est.tau = tau;
+    est.head_backoff = head_backoff;
+    est.p_collision = head_attempts + member_attempts > 0
+                          ? (head_attempts * collide_head + n * busy * collided) / (head_attempts + member_attempts)
+                          : 0;
+    est.offered = n * lambda / BACKOFF_UNIT * PACKET_SIZE / SLOT_TIME;
+    est.throughput = n * lam_eff / BACKOFF_UNIT * PACKET_SIZE / SLOT_TIME;
+    // 包在最后一次交换的PACKET时隙结束时出队，比占用的格点早一个时隙
+    est.access_delay = ((mean_service - 1) * BACKOFF_UNIT + CYCLE_SLOTS - 1) * SLOT_TIME;
+
+    // 逗留时间按Little公式；空队列来的包要先等正在进行的交换结束
+    double exchanges = (1 - head_backoff) * (1 - collide_head) + n * own_rate;
+    double delay = lam_eff > 0 ? queue / lam_eff * BACKOFF_UNIT - 1 : 0;
+    delay += (1 - busy) * fmin(1, exchanges) * BACKOFF_UNIT / 2.0;
+    // 到达时信道空闲、簇头在退避中、又没有别人发送的包当场成功，时延CYCLE_SLOTS-1不计入统计
+    double others = pow(1 - tau, n - 1);
+    double immediate = CYCLE_SLOTS - 1 < MIN_DELAY_SLOT ? (1 - busy) * fmax(0, 1 - fmin(1, exchanges)) * others : 0;
+    est.reported_delay = immediate < 1 ? (delay - immediate * (CYCLE_SLOTS - 1)) / (1 - immediate) * SLOT_TIME : 0;
+    return est;
+}
+
+ModelEstimate estimate_cluster(Cluster* cluster) {
+    ModelParams p;
+    model_params_from_cluster(cluster, &p);
+    return estimate_model(&p);
+}
+
+void print_estimate(Cluster* cluster, ModelEstimate* est) {
+    printf("Cluster %d model: stations: %d, busy: %.4f, tau: %.4f, head_backoff: %.4f, p_collision: %.4f, offered: %.6fb/us, throughput: %.6fb/us, access_delay: %.3fus, reported_delay: %.3fus (%d iterations)\n",
+           cluster->id, est->stations, est->busy, est->tau, est->head_backoff, est->p_collision, est->offered, est->throughput,
+           est->access_delay, est->reported_delay, est->iterations);
+}
+
+double relative_error(double model, double sim) {
+    if (sim == 0) return model == 0 ? 0 : 1;
+    return fabs(model - sim) / sim;
+}
+
+// 校准时每个无人机的能量：足够大，能量等级不变也不会死亡，模拟一直处于模型假设的稳态
+#define CALIBRATE_ENERGY 100000000
+// 预热上限：每个成员至少成功发送QUEUE_LEN个包才开始统计
+#define CALIBRATE_WARMUP_MAX 50000000
+#define CALIBRATE_SLOTS 1000000 // 默认统计窗口（时隙）
+
+// 校准点：负载（每period个时隙每个节点以prob的概率来一个包）和簇内成员数，从轻载、拥塞到饱和
+typedef struct {
+    int period;
+    double prob;
+    int members;
+} CalibratePoint;
+const CalibratePoint calibrate_points[] = {
+    {10, 0.001, NUM_DRONES_PER_CLUSTER - 1}, {10, 0.003, NUM_DRONES_PER_CLUSTER - 1}, {10, 0.01, NUM_DRONES_PER_CLUSTER - 1},
+    {10, 0.03, NUM_DRONES_PER_CLUSTER - 1},  {10, 0.1, NUM_DRONES_PER_CLUSTER - 1},   {10, 0.3, NUM_DRONES_PER_CLUSTER - 1},
+    {10, 0.01, 5},                           {10, 0.1, 5},                            {10, 0.03, 10},
+    {1, 1.0, NUM_DRONES_PER_CLUSTER - 1},
+};
+#define CALIBRATE_POINTS (int)(sizeof(calibrate_points) / sizeof(calibrate_points[0]))
+
+// 在各校准点上对比模型和模拟结果：能量不受限，预热到稳态后在slots个时隙的窗口上统计。
+// 模型按每次运行预热后的簇状态给出预测，误差是各次运行相对误差的平均
+void calibrate_model(int runs, int slots) {
+    Cluster* clusters = alloc_clusters();
+    int saved_period = want_period;
+    double saved_prob = want_prob;
+    bool saved_quiet = quiet_mode;
+    double err_sum[3] = {0}, err_max[3] = {0}; // 吞吐量、碰撞概率、时延
+    quiet_mode = true;
+
+    printf("period  prob    n   thr_model  thr_sim    p_model  p_sim    delay_model  delay_sim    err_thr  err_delay\n");
+    for (int pt = 0; pt < CALIBRATE_POINTS; ++pt) {
+        const CalibratePoint* point = &calibrate_points[pt];
+        int members = point->members < NUM_DRONES_PER_CLUSTER - 1 ? point->members : NUM_DRONES_PER_CLUSTER - 1;
+        want_period = point->period;
+        want_prob = point->prob;
+        double model[3] = {0}, sim[3] = {0}, err[3] = {0};
+
+        for (int seed = 1; seed <= runs; ++seed) {
+            srand(seed);
+            initialize_clusters(clusters);
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                clusters[c].node_num = members + 1;
+                counters[c].alive = members + 1;
+                for (int d = 0; d < clusters[c].node_num; ++d) clusters[c].drones[d].energy = CALIBRATE_ENERGY;
+            }
+            reset_statistics();
+
+            int slot = 0;
+            for (bool warm = false; !warm && slot < CALIBRATE_WARMUP_MAX; ++slot) {
+                simulate_slot(clusters, slot);
+                warm = true;
+                for (int c = 0; c < NUM_CLUSTERS && warm; ++c) {
+                    for (int d = 0; d < clusters[c].node_num; ++d) {
+                        Node* node = &clusters[c].drones[d];
+                        if (!node->is_head && node->total_sent_packet < QUEUE_LEN) {
+                            warm = false;
+                            break;
+                        }
+                    }
+                }
+            }
+            reset_statistics();
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                for (int d = 0; d < clusters[c].node_num; ++d) {
+                    clusters[c].drones[d].total_delay_slot = 0;
+                    clusters[c].drones[d].total_sent_packet = 0;
+                }
+            }
+
+            double m[3] = {0};
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                ModelEstimate est = estimate_cluster(&clusters[c]);
+                m[0] += est.throughput / NUM_CLUSTERS;
+                m[1] += est.p_collision / NUM_CLUSTERS;
+                m[2] += est.reported_delay / NUM_CLUSTERS;
+            }
+
+            for (int s = 0; s < slots; ++s) simulate_slot(clusters, slot++);
+
+            double thr_sim = 0;
+            long access = 0, clashed = 0, delay_slots = 0, sent = 0;
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                thr_sim += (double)counters[c].packet * PACKET_SIZE / ((double)slots * SLOT_TIME) / NUM_CLUSTERS;
+                access += counters[c].access;
+                clashed += counters[c].clash_node;
+                for (int d = 0; d < clusters[c].node_num; ++d) {
+                    if (clusters[c].drones[d].is_head) continue;
+                    delay_slots += clusters[c].drones[d].total_delay_slot;
+                    sent += clusters[c].drones[d].total_sent_packet;
+                }
+            }
+            double s[3] = {thr_sim, access ? (double)clashed / access : 0, sent ? delay_slots * SLOT_TIME / sent : 0};
+            for (int i = 0; i < 3; ++i) {
+                model[i] += m[i] / runs;
+                sim[i] += s[i] / runs;
+                err[i] += relative_error(m[i], s[i]) / runs;
+            }
+        }
+
+        printf("%6d  %-6g  %2d  %9.6f  %9.6f  %7.5f  %7.5f  %11.0f  %11.0f  %6.2f%%  %8.2f%%\n", point->period, point->prob, members,
+               model[0], sim[0], model[1], sim[1], model[2], sim[2], 100 * err[0], 100 * err[2]);
+        for (int i = 0; i < 3; ++i) {
+            err_sum[i] += err[i] / CALIBRATE_POINTS;
+            if (err[i] > err_max[i]) err_max[i] = err[i];
+        }
+    }
+
+    if (runs > 0) {
+        printf("--------------------------------------\n");
+        printf("Mean relative error over %d points x %d runs of %d slots: throughput %.2f%% (max %.2f%%), p_collision %.2f%% (max %.2f%%), delay %.2f%% (max %.2f%%)\n",
+               CALIBRATE_POINTS, runs, slots, 100 * err_sum[0], 100 * err_max[0], 100 * err_sum[1], 100 * err_max[1],
+               100 * err_sum[2], 100 * err_max[2]);
+    }
+
+    want_period = saved_period;
+    want_prob = saved_prob;
+    quiet_mode = saved_quiet;
+    free(clusters);
+}
+
+// sweep每个维度最多的取值个数
+#define SWEEP_MAX_VALUES 16
+// 投递的吞吐量不低于负载的这个比例才算没有饱和
+#define SWEEP_DELIVERY_MIN 0.95
+
+// 解析 "a:b:c,a:b:c" 形式的列表，每项是width个用冒号分隔的数，返回项数，格式不对返回-1
+int parse_sweep_list(const char* text, int width, double values[SWEEP_MAX_VALUES][NUM_CLASSES]) {
+    int count = 0;
+    while (*text) {
+        if (count == SWEEP_MAX_VALUES) return -1;
+        for (int i = 0; i < width; ++i) {
+            char* end;
+            values[count][i] = strtod(text, &end);
+            if (end == text) return -1;
+            text = end;
+            if (i + 1 < width) {
+                if (*text != ':') return -1;
+                text++;
+            }
+        }
+        count++;
+        if (*text == ',') text++;
+        else if (*text) return -1;
+    }
+    return count;
+}
+
+// 用分析模型扫描参数网格，不做模拟：每个点给出吞吐量、碰撞概率和时延，
+// 投递不低于负载的SWEEP_DELIVERY_MIN且时延不超过max_delay_ms（毫秒，0表示不限）的点值得再用模拟器细看。
+// 未指定的维度取编译期的默认值和--want-prob/--want-period
+int parameter_sweep(int argc, char* argv[]) {
+    double cw[SWEEP_MAX_VALUES][NUM_CLASSES] = {{CW_P1, CW_P2, CW_P3}};
+    double r[SWEEP_MAX_VALUES][NUM_CLASSES] = {{R1, R2}};
+    double members[SWEEP_MAX_VALUES][NUM_CLASSES] = {{NUM_DRONES_PER_CLUSTER - 1}};
+    double energy[SWEEP_MAX_VALUES][NUM_CLASSES] = {{MAX_ENERGY}};
+    double loads[SWEEP_MAX_VALUES][NUM_CLASSES] = {{want_prob}};
+    int cw_count = 1, r_count = 1, members_count = 1, energy_count = 1, load_count = 1;
+    double max_delay_ms = 0;
+
+    for (int i = 2; i + 1 < argc; ++i) {
+        const char* name = argv[i];
+        const char* value = argv[i + 1];
+        int count = 0;
+        if (strcmp(name, "--cw") == 0) count = cw_count = parse_sweep_list(value, NUM_CLASSES, cw);
+        else if (strcmp(name, "--r") == 0) count = r_count = parse_sweep_list(value, 2, r);
+        else if (strcmp(name, "--members") == 0) count = members_count = parse_sweep_list(value, 1, members);
+        else if (strcmp(name, "--energy") == 0) count = energy_count = parse_sweep_list(value, 1, energy);
+        else if (strcmp(name, "--loads") == 0) count = load_count = parse_sweep_list(value, 1, loads);
+        else if (strcmp(name, "--max-delay") == 0) max_delay_ms = atof(value);
+        else continue;
+        if (count < 0) {
+            fprintf(stderr, "invalid %s %s\n", name, value);
+            return 1;
+        }
+        i++;
+    }
+    for (int a = 0; a < cw_count; ++a) {
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            if (cw[a][k] < 1) {
+                fprintf(stderr, "--cw windows must be at least 1\n");
+                return 1;
+            }
+        }
+    }
+    for (int a = 0; a < r_count; ++a) {
+        if (r[a][0] < 0 || r[a][0] > r[a][1] || r[a][1] > 1) {
+            fprintf(stderr, "--r needs 0 <= R1 <= R2 <= 1\n");
+            return 1;
+        }
+    }
+    for (int a = 0; a < members_count; ++a) {
+        if (members[a][0] < 1) {
+            fprintf(stderr, "--members must be positive\n");
+            return 1;
+        }
+    }
+    for (int a = 0; a < load_count; ++a) {
+        if (loads[a][0] <= 0 || loads[a][0] > 1) {
+            fprintf(stderr, "--loads must be in (0, 1]\n");
+            return 1;
+        }
+    }
+
+    int points = 0, promising = 0;
+    printf("P1  P2  P3   R1    R2     n   energy  prob      offered    thr        p_coll   delay_ms\n");
+    for (int a = 0; a < cw_count; ++a) {
+        for (int b = 0; b < r_count; ++b) {
+            for (int c = 0; c < members_count; ++c) {
+                for (int d = 0; d < energy_count; ++d) {
+                    for (int e = 0; e < load_count; ++e) {
+                        ModelParams p;
+                        int cw_p[NUM_CLASSES];
+                        model_default_params(&p);
+                        for (int k = 0; k < NUM_CLASSES; ++k) cw_p[k] = (int)cw[a][k];
+                        model_set_windows(&p, cw_p);
+                        p.r1 = r[b][0];
+                        p.r2 = r[b][1];
+                        p.members = (int)members[c][0];
+                        p.energy = (int)energy[d][0];
+                        p.prob = loads[e][0];
+
+                        ModelEstimate est = estimate_model(&p);
+                        double delay_ms = est.reported_delay / 1000;
+                        bool saturated = est.throughput < SWEEP_DELIVERY_MIN * est.offered;
+                        bool slow = max_delay_ms > 0 && delay_ms > max_delay_ms;
+                        points++;
+                        if (!saturated && !slow) promising++;
+                        printf("%-3d %-3d %-3d  %-4.2f  %-4.2f  %3d  %6d  %-8g  %9.6f  %9.6f  %7.5f  %9.3f  %s\n", cw_p[0], cw_p[1],
+                               cw_p[2], p.r1, p.r2, p.members, p.energy, p.prob, est.offered, est.throughput, est.p_collision,
+                               delay_ms, saturated ? "saturated" : slow ? "slow" : "promising");
+                    }
+                }
+            }
+        }
+    }
+    printf("--------------------------------------\n");
+    printf("%d of %d points promising (delivered >= %.0f%% of offered", promising, points, 100 * SWEEP_DELIVERY_MIN);
+    if (max_delay_ms > 0) printf(", delay <= %gms", max_delay_ms);
+    printf(")\n");
+    return 0;
+}
+
+// 优先级检查的负载点（每want_period个时隙产生数据的概率），从轻载到过载
+const double priority_loads[] = {0.005, 0.01, 0.02, 0.03, 0.05, 0.1};
+#define PRIORITY_LOADS (int)(sizeof(priority_loads) / sizeof(priority_loads[0]))
+// 投递率低于此值的类别时延不参与比较：大部分包被拒绝或挤出，送达的多是到达时队列恰好空着的幸存者
+#define PRIORITY_DELIVERY_MIN 0.5
+
+// 按负载报告各类别的平均时延和投递率：能量不受限，预热slots/10个时隙后统计。
+// 投递率达标的类别之间时延必须按控制<遥测<视频排序，且投递率不达标的类别优先级不能高于达标的类别。
+// 簇头从不出队，它收到的包几乎都被拒绝，所以轻载时投递率也只有95%左右。不满足时返回1
+int priority_check(int runs, int slots) {
+    Cluster* clusters = alloc_clusters();
+    double saved_prob = want_prob;
+    bool saved_quiet = quiet_mode;
+    int failures = 0;
+
+    quiet_mode = true;
+    printf("load    drop    control(ms/deliv)    telemetry(ms/deliv)  video(ms/deliv)      order\n");
+    for (int l = 0; l < PRIORITY_LOADS; ++l) {
+        long arrived[NUM_CLASSES] = {0}, sent[NUM_CLASSES] = {0}, dropped[NUM_CLASSES] = {0};
+        double delay[NUM_CLASSES] = {0};
+        want_prob = priority_loads[l];
+        for (int seed = 1; seed <= runs; ++seed) {
+            srand(seed);
+            initialize_clusters(clusters);
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                for (int d = 0; d < clusters[c].node_num; ++d) clusters[c].drones[d].energy = CALIBRATE_ENERGY;
+            }
+            int slot = 0;
+            for (; slot < slots / 10; ++slot) simulate_slot(clusters, slot);
+            reset_statistics();
+            for (int s = 0; s < slots; ++s) simulate_slot(clusters, slot++);
+            for (int c = 0; c < NUM_CLUSTERS; ++c) {
+                for (int k = 0; k < NUM_CLASSES; ++k) {
+                    ClassStats* st = &class_stats[c][k];
+                    arrived[k] += st->arrived;
+                    sent[k] += st->sent;
+                    dropped[k] += st->rejected + st->preempted;
+                    delay[k] += st->delay_slot;
+                }
+            }
+        }
+
+        long total_arrived = 0, total_dropped = 0;
+        double ms[NUM_CLASSES], deliv[NUM_CLASSES];
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            total_arrived += arrived[k];
+            total_dropped += dropped[k];
+            ms[k] = sent[k] ? delay[k] * SLOT_TIME / sent[k] / 1000 : 0;
+            deliv[k] = arrived[k] ? (double)sent[k] / arrived[k] : 0;
+        }
+        double drop = total_arrived ? (double)total_dropped / total_arrived : 0;
+        bool ok = true;
+        int last = -1; // 上一个投递率达标的类别
+        for (int k = 0; k < NUM_CLASSES; ++k) {
+            if (sent[k] == 0 || deliv[k] < PRIORITY_DELIVERY_MIN) continue;
+            if (last != k - 1 || (last >= 0 && ms[last] >= ms[k])) ok = false;
+            last = k;
+        }
+        if (!ok) failures++;
+        printf("%-7.3f %5.1f%%  %8.3f / %5.1f%%   %8.3f / %5.1f%%   %8.3f / %5.1f%%   %s\n", want_prob, 100 * drop,
+               ms[0], 100 * deliv[0], ms[1], 100 * deliv[1], ms[2], 100 * deliv[2], ok ? "ok" : "INVERTED");
+    }
+    printf("(delays of classes delivering less than %.0f%% of their packets are not compared)\n", 100 * PRIORITY_DELIVERY_MIN);
+
+    want_prob = saved_prob;
+    quiet_mode = saved_quiet;
+    free(clusters);
+    return failures ? 1 : 0;
+}
+
+// 解析 "控制,遥测,视频" 形式的业务构成并归一化
+bool parse_mix(const char* text, double mix[]) {
+    double sum = 0;
+    if (sscanf(text, "%lf,%lf,%lf", &mix[0], &mix[1], &mix[2]) != NUM_CLASSES) return false;
+    for (int k = 0; k < NUM_CLASSES; ++k) {
+        if (mix[k] < 0) return false;
+        sum += mix[k];
+    }
+    if (sum <= 0) return false;
+    for (int k = 0; k < NUM_CLASSES; ++k) mix[k] /= sum;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* scenario_path = NULL;
+    const char* shm_name = NULL;
+    const char* trace_path = NULL;
+    double converge_target = 0;
+    bool lifetime_mode = false;
+    int max_slots = 0; // 0表示按模式取默认值
+    unsigned seed = 0;
+    bool seeded = false;
+
+    // --mix c,t,v: 所有节点的默认业务构成
+    // --scenario FILE: 从二进制场景文件读取初始拓扑
+    // --shm [/NAME]: 把进度和计数器发布到共享内存段，供tdma-top查看
+    // --relay, --sink x,y: 簇头把收到的包多跳中继到汇聚节点
+    // --converge REL [--max-slots N]: 吞吐量和时延的相对置信区间半宽小于REL时提前结束
+    // --lifetime [--max-slots N]: 用自适应粗化一直模拟到网络死亡，报告寿命
+    // --want-prob P, --want-period N: 业务负载
+    // --trace FILE: 把每个时隙结束后的状态哈希写入轨迹文件
+    // --seed N: 固定随机数种子（默认取当前时间），用于生成可复现的轨迹
+    // --shards [N]: 用N个分片并行模拟（默认每个在线CPU一个，不输出逐时隙日志，不能与--converge、--lifetime同用）
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            if (!parse_mix(argv[i + 1], default_mix)) {
+                fprintf(stderr, "invalid --mix %s, expected control,telemetry,video\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) scenario_path = argv[i + 1];
+        if (strcmp(argv[i], "--relay") == 0) relay_enabled = true;
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) trace_path = argv[i + 1];
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned)atoi(argv[i + 1]);
+            seeded = true;
+        }
+        if (strcmp(argv[i], "--converge") == 0 && i + 1 < argc) converge_target = atof(argv[i + 1]);
+        if (strcmp(argv[i], "--lifetime") == 0) lifetime_mode = true;
+        if (strcmp(argv[i], "--max-slots") == 0 && i + 1 < argc) max_slots = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--want-prob") == 0 && i + 1 < argc) want_prob = atof(argv[i + 1]);
+        if (strcmp(argv[i], "--want-period") == 0 && i + 1 < argc) want_period = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--shards") == 0) {
+            shard_mode = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') shard_count = atoi(argv[i + 1]);
+        }
+        if (strcmp(argv[i], "--sink") == 0 && i + 1 < argc) {
+            if (sscanf(argv[i + 1], "%lf,%lf", &sink_x, &sink_y) != 2) {
+                fprintf(stderr, "invalid --sink %s, expected x,y\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        if (strcmp(argv[i], "--shm") == 0) {
+            shm_name = i + 1 < argc && argv[i + 1][0] == '/' ? argv[i + 1] : TDMA_STATS_DEFAULT_NAME;
+        }
+    }
+
+    if (want_period <= 0) {
+        fprintf(stderr, "--want-period must be positive\n");
+        return 1;
+    }
+    if (shard_mode && (converge_target > 0 || lifetime_mode)) {
+        fprintf(stderr, "--shards cannot be combined with %s\n", lifetime_mode ? "--lifetime" : "--converge");
+        return 1;
+    }
+
+    // convert in.csv out.tdms: 把CSV拓扑转换成二进制场景文件
+    if (argc > 1 && strcmp(argv[1], "convert") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s convert in.csv out.tdms\n", argv[0]);
+            return 1;
+        }
+        return convert_scenario(argv[2], argv[3]);
+    }
+
+    // tracecmp a b: 比较两个轨迹文件
+    if (argc > 1 && strcmp(argv[1], "tracecmp") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s tracecmp a.trace b.trace\n", argv[0]);
+            return 2;
+        }
+        return compare_traces(argv[2], argv[3]);
+    }
+
+    // diff ENGINE [scenarios] [slots]: 在随机场景上与参考引擎逐时隙比较
+    if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "usage: %s diff ENGINE [scenarios] [slots]\n", argv[0]);
+            return 2;
+        }
+        return differential_test(argv[2], argc > 3 ? atoi(argv[3]) : 1000, argc > 4 ? atoi(argv[4]) : TOTAL_TIME_SLOTS);
+    }
+
+    // scale [slots] [max_shards]: 分片引擎按分片数的加速比
+    if (argc > 1 && strcmp(argv[1], "scale") == 0) {
+        int slots = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : TOTAL_TIME_SLOTS;
+        int max_shards = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (max_shards < 1) max_shards = 1;
+        if (max_shards > SHARD_MAX) max_shards = SHARD_MAX;
+        return shard_scaling(slots, max_shards);
+    }
+
+    // model [seed]: 对生成的拓扑给出分析模型的预测
+    if (argc > 1 && strcmp(argv[1], "model") == 0) {
+        srand(argc > 2 ? atoi(argv[2]) : time(NULL));
+        Cluster* clusters = alloc_clusters();
+        initialize_clusters(clusters);
+        for (int c = 0; c < NUM_CLUSTERS; ++c) {
+            ModelEstimate est = estimate_cluster(&clusters[c]);
+            print_estimate(&clusters[c], &est);
+        }
+        free(clusters);
+        return 0;
+    }
+
+    // calibrate [runs] [slots]: 报告模型相对模拟的误差
+    if (argc > 1 && strcmp(argv[1], "calibrate") == 0) {
+        calibrate_model(argc > 2 ? atoi(argv[2]) : 3, argc > 3 ? atoi(argv[3]) : CALIBRATE_SLOTS);
+        return 0;
+    }
+
+    // sweep [--cw P1:P2:P3,...] [--r R1:R2,...] [--members N,...] [--energy E,...] [--loads P,...] [--max-delay MS]:
+    // 用分析模型扫描参数网格，筛出值得模拟的点
+    if (argc > 1 && strcmp(argv[1], "sweep") == 0) {
+        return parameter_sweep(argc, argv);
+    }
+
+    // priority [runs] [slots]: 各负载下按类别的时延，检查高优先级类别的时延是否更低
+    if (argc > 1 && strcmp(argv[1], "priority") == 0) {
+        return priority_check(argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 3,
+                              argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : CALIBRATE_SLOTS);
+    }
+
+    // lifetime [runs] [max_slots]: 自适应粗化的寿命相对全程逐时隙模拟的误差和加速比
+    if (argc > 1 && strcmp(argv[1], "lifetime") == 0) {
+        int runs = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 10;
+        int slots = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : LIFETIME_MAX_SLOTS;
+        return validate_lifetime(runs, slots);
+    }
+
+    if (max_slots <= 0) max_slots = lifetime_mode ? LIFETIME_MAX_SLOTS : TOTAL_TIME_SLOTS * CONV_MAX_FACTOR;
+
+    srand(seeded ? seed : (unsigned)time(NULL)); // 初始化随机数种子
+
+    Cluster* clusters = alloc_clusters();
+    Scenario scenario;
+    if (scenario_path) {
+        double start = now_ms();
+        if (!load_scenario(scenario_path, &scenario)) return 1;
+        double mapped = now_ms();
+        if (!initialize_clusters_from_scenario(clusters, &scenario)) {
+            unload_scenario(&scenario);
+            return 1;
+        }
+        // 映射只校验文件头，无人机数据在初始化簇时才真正从文件读入
+        printf("Loaded scenario %s (%u clusters, %llu drones): mapped in %.3fms, clusters initialised in %.3fms\n",
+               scenario_path, scenario.header->num_clusters, (unsigned long long)scenario.header->num_drones,
+               mapped - start, now_ms() - mapped);
+    } else {
+        initialize_clusters(clusters);
+    }
+
+    if (relay_enabled) relay_init(clusters);
+    if (converge_target > 0) convergence_init(converge_target, max_slots);
+    if (shm_name && !open_stats_segment(shm_name, converge_target > 0 || lifetime_mode ? max_slots : TOTAL_TIME_SLOTS)) return 1;
+    if (trace_path && !open_trace(trace_path)) return 1;
 
     // 开始模拟
-    simulate_tdma_communication(clusters);
+    int slots;
+    if (lifetime_mode) {
+        quiet_mode = true;
+        LifetimeResult result = simulate_lifetime(clusters, max_slots, true);
+        slots = result.slots;
+        print_final_statistics(clusters, slots);
+        print_lifetime(&result);
+    } else {
+        slots = simulate_tdma_communication(clusters);
+    }
+
+    close_stats_segment(slots);
+    close_trace();
 
+    if (scenario_path) unload_scenario(&scenario);
+    free(clusters);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,120 @@
+// tdma-top：实时查看myTDMA通过--shm发布的进度和计数器
+// 编译：gcc -O2 -o tdma-top tdma-top.c -lrt
+// 用法：tdma-top [/NAME] [刷新间隔ms]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tdma_stats.h"
+
+// 最多逐行显示的簇数，其余只计入合计
+#define MAX_ROWS 20
+
+void sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+// 连接统计段，段不存在时等待模拟器创建
+TdmaStatsHeader* attach(const char* name, size_t* size) {
+    for (;;) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TdmaStatsHeader)) {
+                void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                close(fd);
+                if (base == MAP_FAILED) {
+                    perror(name);
+                    return NULL;
+                }
+                TdmaStatsHeader* h = base;
+                uint32_t magic = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE);
+                if (magic == 0) {
+                    // 模拟器刚创建段，还没写好文件头
+                    munmap(base, st.st_size);
+                    fprintf(stderr, "\rwaiting for %s ...", name);
+                    sleep_ms(10);
+                    continue;
+                }
+                if (magic != TDMA_STATS_MAGIC || h->version != TDMA_STATS_VERSION ||
+                    (size_t)st.st_size < tdma_stats_size(h->num_clusters)) {
+                    fprintf(stderr, "%s: not a tdma stats segment\n", name);
+                    munmap(base, st.st_size);
+                    return NULL;
+                }
+                *size = tdma_stats_size(h->num_clusters);
+                return h;
+            }
+            close(fd);
+        }
+        fprintf(stderr, "\rwaiting for %s ...", name);
+        sleep_ms(200);
+    }
+}
+
+// 各簇计数器之和：单个簇的int32_t计数器在上千个簇相加时会溢出，所以用int64_t累加
+typedef struct {
+    int64_t idle_slot, clash_slot, rts, packet, extra, access, clash_node, alive;
+} CounterTotals;
+
+void show(const TdmaStatsHeader* h) {
+    const ClusterCounters* counters = tdma_stats_counters((TdmaStatsHeader*)h);
+    CounterTotals total;
+    memset(&total, 0, sizeof(total));
+
+    printf("\033[H\033[J");
+    printf("slot %llu/%llu  %.0f slots/s  elapsed %.1fs  %s\n",
+           (unsigned long long)h->slot, (unsigned long long)h->total_slots, h->slots_per_sec, h->elapsed_sec,
+           h->running ? "running" : "finished");
+    printf("--------------------------------------\n");
+    printf("%8s %8s %8s %8s %8s %8s %8s %8s\n", "cluster", "idle", "clash", "rts", "packet", "extra", "p_clash", "alive");
+    for (uint32_t c = 0; c < h->num_clusters; ++c) {
+        const ClusterCounters* cc = &counters[c];
+        total.idle_slot += cc->idle_slot;
+        total.clash_slot += cc->clash_slot;
+        total.rts += cc->rts;
+        total.packet += cc->packet;
+        total.extra += cc->extra;
+        total.access += cc->access;
+        total.clash_node += cc->clash_node;
+        total.alive += cc->alive;
+        if (c < MAX_ROWS) {
+            printf("%8u %8d %8d %8d %8d %8d %8.4f %8d\n", c, cc->idle_slot, cc->clash_slot, cc->rts, cc->packet, cc->extra,
+                   cc->access ? (double)cc->clash_node / cc->access : 0, cc->alive);
+        }
+    }
+    if (h->num_clusters > MAX_ROWS) printf("%8s (%u more clusters)\n", "...", h->num_clusters - MAX_ROWS);
+    printf("%8s %8lld %8lld %8lld %8lld %8lld %8.4f %8lld\n", "total", (long long)total.idle_slot, (long long)total.clash_slot,
+           (long long)total.rts, (long long)total.packet, (long long)total.extra,
+           total.access ? (double)total.clash_node / total.access : 0, (long long)total.alive);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = argc > 1 ? argv[1] : TDMA_STATS_DEFAULT_NAME;
+    int interval = argc > 2 ? atoi(argv[2]) : 500;
+    if (interval <= 0) interval = 500;
+
+    size_t size;
+    TdmaStatsHeader* h = attach(name, &size);
+    if (!h) return 1;
+
+    TdmaStatsHeader* snapshot = malloc(size);
+    for (;;) {
+        // 写者正在发布时稍后重试，写者永远不会被读者阻塞
+        while (!tdma_stats_read(h, snapshot, size)) sleep_ms(1);
+        show(snapshot);
+        if (!snapshot->running) break;
+        sleep_ms(interval);
+    }
+
+    free(snapshot);
+    munmap(h, size);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef TDMA_STATS_H
+#define TDMA_STATS_H
+
+// myTDMA与tdma-top共享的统计段布局。
+// 段 = TdmaStatsHeader + ClusterCounters[num_clusters]，由模拟器单线程写入，
+// 读者用seqlock取一致快照：seq为奇数表示正在写，前后两次读到的seq不同则重读。
+// 段创建后先全为0，写者填好其余文件头字段后才（release）写入magic，读者看到magic为0时应稍后重试。
+
+#include <stdint.h>
+#include <string.h>
+
+#define TDMA_STATS_MAGIC 0x53414d54u // "TMAS"
+#define TDMA_STATS_VERSION 1
+#define TDMA_STATS_DEFAULT_NAME "/tdma-stats"
+#define CACHE_LINE 64
+
+typedef struct {
+    _Alignas(CACHE_LINE) uint32_t magic;
+    uint32_t version;
+    uint32_t num_clusters;
+    uint32_t running;        // 模拟结束后置0
+    uint64_t seq;            // seqlock序号
+    uint64_t slot;           // 已完成的时隙数
+    uint64_t total_slots;    // 计划模拟的时隙数
+    double slots_per_sec;    // 最近一次发布区间内的速度
+    double elapsed_sec;      // 从模拟开始到最近一次发布的时间
+} TdmaStatsHeader;
+
+// 每个簇的计数器独占缓存行
+typedef struct {
+    _Alignas(CACHE_LINE) int32_t idle_slot;
+    int32_t clash_slot;
+    int32_t rts;
+    int32_t cts;
+    int32_t data;
+    int32_t aci;
+    int32_t beacon;
+    int32_t packet;
+    int32_t extra;      // 完成的簇间中继交换次数
+    int32_t access;     // 竞争时隙内的发送尝试次数
+    int32_t clash_node; // 发生冲突的发送尝试次数
+    int32_t alive;      // 存活的无人机数
+} ClusterCounters;
+
+static inline size_t tdma_stats_size(uint32_t num_clusters) {
+    return sizeof(TdmaStatsHeader) + (size_t)num_clusters * sizeof(ClusterCounters);
+}
+
+static inline ClusterCounters* tdma_stats_counters(TdmaStatsHeader* h) {
+    return (ClusterCounters*)(h + 1);
+}
+
+// 写者：begin与end之间修改段内数据，写者从不等待
+static inline void tdma_stats_write_begin(TdmaStatsHeader* h) {
+    uint64_t seq = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void tdma_stats_write_end(TdmaStatsHeader* h) {
+    uint64_t seq = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+// 读者：把整个段复制到dst，成功返回1；写者正忙时返回0，由调用方稍后重试
+static inline int tdma_stats_read(const TdmaStatsHeader* h, void* dst, size_t size) {
+    uint64_t before = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) return 0;
+    memcpy(dst, h, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t after = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+    return before == after;
+}
+
+#endif